@@ -0,0 +1,48 @@
+"""
+GEMM time with the built-in blocking against the configuration the autotuner
+measures for each shape, on a few Linear-like shapes. Tuning results go to a
+scratch cache file, not the user's.
+
+Run from the repository root: python3 benchmarks/autotune.py
+"""
+import os
+import sys
+import tempfile
+import timeit
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+import src
+from src.tensor import Tensor
+
+SHAPES = [(1024, 64, 1024), (4096, 32, 256), (512, 512, 512), (256, 2048, 2048)]
+
+
+def per_call_ms(fn, number):
+    best = min(timeit.repeat(fn, number=number, repeat=5))
+    return best / number * 1e3
+
+
+def main(number=5):
+    with tempfile.TemporaryDirectory() as directory:
+        src.set_autotune_cache_file(os.path.join(directory, "autotune.txt"))
+        src.clear_autotune_cache()
+
+        print("M x N x K: best of 5 x {} calls".format(number))
+        for M, N, K in SHAPES:
+            a = Tensor.empty([M, K]).uniform_()
+            b = Tensor.empty([K, N]).uniform_()
+            times = {}
+            for mode in ("off", "online"):
+                src.set_autotune_mode(mode)
+                a.tensor.matmul(b.tensor)  # tunes the shape when online
+                times[mode] = per_call_ms(lambda: a.tensor.matmul(b.tensor), number)
+            kc, nc, threads = src.lookup_gemm(M, N, K)
+            print("  {:>4} x {:>4} x {:>4}  default {:8.2f} ms  tuned {:8.2f} ms  (kc={}, nc={}, threads={})".format(
+                M, N, K, times["off"], times["online"], kc, nc, threads))
+
+        src.set_autotune_cache_file(None)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,55 @@
+"""
+Per-op dispatch overhead on a 16-element add: the native handle method, ctypes
+with fixed signatures, ctypes with signatures re-assigned on every call (how
+Tensor used to call the backend) and the full Tensor operator, autograd
+bookkeeping included.
+
+Run from the repository root: python3 benchmarks/dispatch.py
+"""
+import ctypes
+import os
+import sys
+import timeit
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from src.tensor import Tensor, CTensor
+
+
+def per_call_ns(fn, number):
+    best = min(timeit.repeat(fn, number=number, repeat=5))
+    return best / number * 1e9
+
+
+def main(number=200000):
+    a = Tensor([float(i) for i in range(16)])
+    b = Tensor([float(i) for i in range(16)])
+    a_ptr, b_ptr = a.tensor._as_parameter_, b.tensor._as_parameter_
+
+    lib = Tensor._C
+    signature = ([ctypes.POINTER(CTensor), ctypes.POINTER(CTensor)], ctypes.POINTER(CTensor))
+    lib.add_tensor.argtypes, lib.add_tensor.restype = signature
+    lib.free_tensor.argtypes, lib.free_tensor.restype = [ctypes.POINTER(CTensor)], None
+
+    def ctypes_fixed():
+        lib.free_tensor(lib.add_tensor(a_ptr, b_ptr))
+
+    def ctypes_per_call():
+        lib.add_tensor.argtypes, lib.add_tensor.restype = signature
+        lib.free_tensor.argtypes, lib.free_tensor.restype = [ctypes.POINTER(CTensor)], None
+        lib.free_tensor(lib.add_tensor(a_ptr, b_ptr))
+
+    rows = [
+        ("native handle", lambda: a.tensor.add(b.tensor)),
+        ("ctypes, fixed signature", ctypes_fixed),
+        ("ctypes, per-call signature", ctypes_per_call),
+        ("Tensor.__add__", lambda: a + b),
+    ]
+
+    print("16-element add, best of 5 x {} calls".format(number))
+    for name, fn in rows:
+        print("  {:<28} {:8.0f} ns/op".format(name, per_call_ns(fn, number)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,54 @@
+"""
+Latency of tiny products, which take the specialized kernels in cpu.cpp when
+N and K are among SMALL_GEMM_SIZES (1, 2, 4, 8, 16, 32, 64 by default), and
+of a 3-layer 32-wide MLP on one sample, by native handle and through Module.
+
+Run from the repository root: python3 benchmarks/small_gemm.py
+"""
+import os
+import sys
+import timeit
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from src import nn
+from src.tensor import Tensor
+
+SHAPES = [(8, 1, 8), (32, 1, 32), (16, 16, 16), (64, 8, 64), (10, 1, 10)]
+
+
+def per_call_us(fn, number):
+    best = min(timeit.repeat(fn, number=number, repeat=5))
+    return best / number * 1e6
+
+
+def main(number=20000):
+    print("M x N x K matmul, best of 5 x {} calls".format(number))
+    for M, N, K in SHAPES:
+        a = Tensor.empty([M, K]).uniform_().tensor
+        b = Tensor.empty([K, N]).uniform_().tensor
+        print("  {:>3} x {:>3} x {:>3}  {:8.2f} us".format(M, N, K, per_call_us(lambda: a.matmul(b), number)))
+
+    layers = [nn.Linear(32, 32, bias=False) for _ in range(3)]
+    x = Tensor.empty([32, 1]).uniform_()
+    weights = [layer.weight.tensor for layer in layers]
+
+    def handles():
+        h = x.tensor
+        for w in weights:
+            h = w.matmul(h).sigmoid()
+        return h
+
+    def modules():
+        h = x
+        for layer in layers:
+            h = layer(h).sigmoid()
+        return h
+
+    print("3-layer MLP, 32 wide, batch 1")
+    print("  {:<16} {:8.2f} us".format("native handles", per_call_us(handles, number)))
+    print("  {:<16} {:8.2f} us".format("Module", per_call_us(modules, number)))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,4 +1,10 @@
 from src.tensor import *
+from src.sparse import *
+from src.distributed import *
+from src.memory import *
+from src.rng import *
+from src.stream import *
+from src.autotune import *
 from .nn import *
 from .optim import *
 from .utils import *
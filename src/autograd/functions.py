@@ -38,7 +38,7 @@ class SumBackward:
         self.input = [x]
 
     def backward(self, gradient):
-        return [float(gradient.tensor.contents.data[0]) * self.input[0].ones_like()]
+        return [gradient[[0] * gradient.ndim] * self.input[0].ones_like()]
     
 class TBackward:
     def __init__(self, x):
@@ -47,18 +47,35 @@ class TBackward:
     def backward(self, gradient):
         return [gradient.T]
 class MatmulBackward:
-    def __init__(self, x, y):
+    def __init__(self, x, y, transpose_x=False, transpose_y=False):
         self.input = [x, y]
+        self.transpose_x = transpose_x
+        self.transpose_y = transpose_y
+
+    def _grad(self, a, b, transpose_a, transpose_b, like):
+        # Transposes are folded into the GEMM flags; a broadcast operand's
+        # gradient is summed over the batch inside the GEMM
+        shape = a._matmul_shape(b, transpose_a, transpose_b)
+        if len(shape) != like.ndim or shape[:-2] != like.shape[:-2]:
+            grad = like.zeros_like()
+            return grad.matmul_accumulate_(a, b, 1.0, 0.0, transpose_a, transpose_b)
+        return a.matmul(b, transpose_a, transpose_b)
 
     def backward(self, gradient):
         x, y = self.input
-        
-        if x.ndim != y.ndim: # broadcasted case
-            aux = (gradient @ y.transpose(-1,-2))
-            aux_sum = aux.sum(axis=0)
-            return [aux_sum, x.transpose(-1,-2) @ gradient]
+
+        # z = op(x) @ op(y): d op(x) = g @ op(y)^T, d op(y) = op(x)^T @ g
+        if self.transpose_x:
+            grad_x = self._grad(y, gradient, self.transpose_y, True, x)
         else:
-            return [gradient @ y.transpose(-1,-2), x.transpose(-1,-2) @ gradient]
+            grad_x = self._grad(gradient, y, False, not self.transpose_y, x)
+
+        if self.transpose_y:
+            grad_y = self._grad(gradient, x, True, self.transpose_x, y)
+        else:
+            grad_y = self._grad(x, gradient, not self.transpose_x, False, y)
+
+        return [grad_x, grad_y]
 
 class SubBackward:
     def __init__(self, x, y):
@@ -156,4 +173,141 @@ class TransposeBackward:
 
     def backward(self, gradient):
         return [gradient.transpose(self.axis2, self.axis1)]
-    
\ No newline at end of file
+    
+class Conv2dBackward:
+    def __init__(self, x, weight, bias, stride, padding, dilation, groups):
+        self.input = [x, weight, bias]
+        self.stride = stride
+        self.padding = padding
+        self.dilation = dilation
+        self.groups = groups
+
+    def backward(self, gradient):
+        x, weight, bias = self.input
+        args = (self.stride, self.padding, self.dilation, self.groups)
+
+        # The first layer's image and frozen weights need no gradient
+        grad_x = gradient.conv2d_grad(x, weight, 'input', *args) if x.requires_grad else None
+        grad_weight = gradient.conv2d_grad(x, weight, 'weight', *args) if weight.requires_grad else None
+        grad_bias = gradient.conv2d_grad(x, weight, 'bias', *args) if bias is not None else None
+
+        return [grad_x, grad_weight, grad_bias]
+
+class Pool2dBackward:
+    def __init__(self, x, mode, kernel_size, stride, padding):
+        self.input = [x]
+        self.mode = mode
+        self.kernel_size = kernel_size
+        self.stride = stride
+        self.padding = padding
+
+    def backward(self, gradient):
+        x = self.input[0]
+        return [gradient.pool2d_grad(x, self.mode, self.kernel_size, self.stride, self.padding)]
+
+class SparseMatmulBackward:
+    def __init__(self, sparse, dense):
+        self.input = [sparse, dense]
+
+    def backward(self, gradient):
+        sparse = self.input[0]
+        # Row-sparse gradient: only rows hit by the sparse operand are stored
+        return [None, sparse.t_matmul(gradient)]
+
+class DenseSparseMatmulBackward:
+    def __init__(self, dense, sparse):
+        self.input = [dense, sparse]
+
+    def backward(self, gradient):
+        sparse = self.input[1]
+        # Column-sparse gradient: only features present in the sparse operand are stored
+        return [sparse.rmatmul_t(gradient), None]
+
+class PermuteBackward:
+    def __init__(self, x, dims):
+        self.input = [x]
+        self.dims = dims
+
+    def backward(self, gradient):
+        inverse = [0] * len(self.dims)
+        for i, d in enumerate(self.dims):
+            inverse[d] = i
+        return [gradient.permute(inverse)]
+
+class DropoutBackward:
+    def __init__(self, x, p, seed, offset):
+        self.input = [x]
+        self.p = p
+        self.seed = seed
+        self.offset = offset
+
+    def backward(self, gradient):
+        # Same (seed, offset) regenerates the forward mask and scale
+        return [gradient._dropout(self.p, self.seed, self.offset)]
+
+class SliceBackward:
+    def __init__(self, x, start, step, shape):
+        self.input = [x]
+        self.start = start
+        self.step = step
+        self.shape = shape
+
+    def backward(self, gradient):
+        x = self.input[0]
+        return [gradient.slice_grad(x, self.start, self.step, self.shape)]
+
+class IndexSelectBackward:
+    def __init__(self, x, dim, index):
+        self.input = [x]
+        self.dim = dim
+        self.index = index
+
+    def backward(self, gradient):
+        x = self.input[0]
+        return [gradient.index_grad(x, 'select', self.dim, self.index)]
+
+class GatherBackward:
+    def __init__(self, x, dim, index):
+        self.input = [x]
+        self.dim = dim
+        self.index = index
+
+    def backward(self, gradient):
+        x = self.input[0]
+        return [gradient.index_grad(x, 'gather', self.dim, self.index)]
+
+class ScatterAddBackward:
+    def __init__(self, x, dim, index, src):
+        self.input = [x, src]
+        self.dim = dim
+        self.index = index
+
+    def backward(self, gradient):
+        return [gradient, gradient.gather(self.dim, self.index)]
+
+class CheckpointBackward:
+    def __init__(self, function, inputs, rng_state):
+        self.input = list(inputs)
+        self.function = function
+        self.rng_state = rng_state
+
+    def backward(self, gradient):
+        # The segment's own graph was dropped after forward: rebuild it from the
+        # saved inputs, replaying the random stream so dropout draws the same
+        # masks, and backpropagate through it. Parameters get their gradients there
+        leaves = [x.as_leaf() if isinstance(x, src.Tensor) else x for x in self.input]
+        state = src.get_rng_state()
+        src.set_rng_state(self.rng_state)
+        try:
+            output = self.function(*leaves)
+        finally:
+            src.set_rng_state(state)
+        output.backward(gradient)
+
+        grads = []
+        for x, leaf in zip(self.input, leaves):
+            if isinstance(x, src.Tensor) and x.requires_grad and leaf.grad is None:
+                grads.append(x.zeros_like())
+            else:
+                grads.append(leaf.grad if isinstance(x, src.Tensor) else None)
+        return grads
@@ -0,0 +1,105 @@
+import ctypes
+from .tensor import Tensor
+from . import _backend
+
+MODES = {'off': 0, 'cached': 1, 'online': 2}
+
+class GemmConfig(ctypes.Structure):
+    _fields_ = [
+        ('kc', ctypes.c_int),
+        ('nc', ctypes.c_int),
+        ('threads', ctypes.c_int),
+    ]
+
+# Signatures are declared once at import, not on every call
+_C = Tensor._C
+_C.set_autotune_mode.argtypes = [ctypes.c_int]
+_C.set_autotune_mode.restype = ctypes.c_int
+
+_C.get_autotune_mode.argtypes = []
+_C.get_autotune_mode.restype = ctypes.c_int
+
+_C.set_autotune_cache_file.argtypes = [ctypes.c_char_p]
+_C.set_autotune_cache_file.restype = ctypes.c_int
+
+_C.autotune_save.argtypes = [ctypes.c_char_p]
+_C.autotune_save.restype = ctypes.c_int
+
+_C.autotune_clear.argtypes = []
+_C.autotune_clear.restype = None
+
+_C.autotune_gemm.argtypes = [ctypes.c_bool, ctypes.c_bool, ctypes.c_int, ctypes.c_int, ctypes.c_int]
+_C.autotune_gemm.restype = ctypes.c_int
+
+_C.autotune_lookup_gemm.argtypes = [ctypes.c_bool, ctypes.c_bool, ctypes.c_int, ctypes.c_int,
+                                    ctypes.c_int, ctypes.POINTER(GemmConfig)]
+_C.autotune_lookup_gemm.restype = ctypes.c_int
+
+def set_autotune_mode(mode):
+    """
+    'online': benchmark each new GEMM shape on first use and keep the fastest
+              blocking and thread count (default)
+    'cached': use measured configurations only, never benchmark; for steady-state
+              runs after tuning offline
+    'off':    always use the built-in blocking
+
+    The starting mode comes from TENSOR_AUTOTUNE
+    """
+    if mode not in MODES:
+        raise ValueError("Unknown autotune mode '{}', expected one of {}".format(mode, list(MODES)))
+
+    Tensor._C.set_autotune_mode(MODES[mode])
+
+def get_autotune_mode():
+    mode = Tensor._C.get_autotune_mode()
+    return next(name for name, value in MODES.items() if value == mode)
+
+def set_autotune_cache_file(path):
+    """
+    Merge the configurations stored in 'path' and append new results to it; None
+    stops persisting. Loaded when the library is: TENSOR_AUTOTUNE_CACHE, else
+    $XDG_CACHE_HOME/tensor_lib/autotune.txt
+    """
+    Tensor._C.set_autotune_cache_file(path.encode() if path is not None else None)
+
+def save_autotune_cache(path=None):
+    """
+    Write every configuration in memory to 'path' (default: the cache file)
+    """
+    if Tensor._C.autotune_save(path.encode() if path is not None else None) != 0:
+        raise OSError("Could not save the autotune cache")
+
+def clear_autotune_cache():
+    Tensor._C.autotune_clear()
+
+def tune_gemm(M, N, K, transpose_a=False, transpose_b=False):
+    """
+    Benchmark op(A) @ op(B) for an MxK op(A) and KxN op(B) now, whatever the mode or size
+    """
+    _backend.synchronize()
+    if Tensor._C.autotune_gemm(transpose_a, transpose_b, M, N, K) != 0:
+        raise ValueError("Could not tune a GEMM of shape {}x{}x{}".format(M, N, K))
+
+def lookup_gemm(M, N, K, transpose_a=False, transpose_b=False):
+    """
+    Measured (kc, nc, threads) for the shape on this host, or None if it was not tuned
+    """
+    config = GemmConfig()
+    if not Tensor._C.autotune_lookup_gemm(transpose_a, transpose_b, M, N, K, ctypes.byref(config)):
+        return None
+    return config.kc, config.nc, config.threads
+
+def autotune(fn, *args, **kwargs):
+    """
+    Offline tuning: run fn (e.g. one training step on representative batches) with
+    online tuning, so every GEMM shape it hits is measured and saved, then return
+    its result. Production runs can then use set_autotune_mode('cached')
+    """
+    previous = get_autotune_mode()
+    set_autotune_mode('online')
+    try:
+        result = fn(*args, **kwargs)
+        _backend.synchronize()
+    finally:
+        set_autotune_mode(previous)
+    return result
@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "autotune.h"
+#include "cpu.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Products below this many multiply-adds finish in well under a millisecond:
+// tuning them would not pay off, and they skip the cache lookup entirely
+#define AUTOTUNE_MIN_WORK (32L * PARALLEL_GRAIN)
+
+// Candidates are timed on at most this many multiply-adds. Rows of C are
+// independent, so a large M is benchmarked on a slice of its rows
+#define AUTOTUNE_BENCH_WORK (1L << 28)
+
+#define AUTOTUNE_REPEATS 3
+
+static const int gemm_kc_candidates[] = {128, 256, 512};
+static const int gemm_nc_candidates[] = {256, 512, 1024};
+
+typedef struct {
+  int trans;  // bit 0: op(A) is transposed, bit 1: op(B)
+  int M, N, K;
+  int host_threads;  // configurations measured with another thread count do not apply
+} GemmKey;
+
+struct GemmKeyHash {
+  size_t operator()(const GemmKey& key) const {
+    size_t hash = (size_t)key.trans;
+    for (int value : {key.M, key.N, key.K, key.host_threads}) {
+      hash = hash * 1000003u ^ (size_t)value;
+    }
+    return hash;
+  }
+};
+
+struct GemmKeyEqual {
+  bool operator()(const GemmKey& a, const GemmKey& b) const {
+    return a.trans == b.trans && a.M == b.M && a.N == b.N && a.K == b.K && a.host_threads == b.host_threads;
+  }
+};
+
+static std::mutex cache_mutex;
+static std::unordered_map<GemmKey, GemmConfig, GemmKeyHash, GemmKeyEqual> gemm_cache;
+static std::string cache_path;  // results are appended here; empty disables persistence
+static std::atomic<int> autotune_mode(AUTOTUNE_ONLINE);
+
+static const char* trans_names[] = {"NN", "TN", "NT", "TT"};
+
+static int host_threads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+static bool in_parallel() {
+#ifdef _OPENMP
+  return omp_in_parallel();
+#else
+  return false;
+#endif
+}
+
+static GemmKey gemm_key(bool trans_a, bool trans_b, int M, int N, int K) {
+  GemmKey key = {(trans_a ? 1 : 0) | (trans_b ? 2 : 0), M, N, K, host_threads()};
+  return key;
+}
+
+static GemmConfig default_gemm_config() {
+  GemmConfig config = {GEMM_KC, GEMM_NC, host_threads()};
+  return config;
+}
+
+static void write_entry(FILE* file, const GemmKey& key, const GemmConfig& config) {
+  fprintf(file, "gemm f32 %s %d %d %d %d %d %d %d\n", trans_names[key.trans], key.M, key.N, key.K,
+          key.host_threads, config.kc, config.nc, config.threads);
+}
+
+// Merges the entries of a cache file; later lines win. Lines for other ops
+// or dtypes are skipped. Expects cache_mutex to be held
+static void load_cache(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    return;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char op[16], dtype[16], trans[4];
+    GemmKey key;
+    GemmConfig config;
+    if (sscanf(line, "%15s %15s %3s %d %d %d %d %d %d %d", op, dtype, trans, &key.M, &key.N, &key.K,
+               &key.host_threads, &config.kc, &config.nc, &config.threads) != 10 ||
+        strcmp(op, "gemm") != 0 || strcmp(dtype, "f32") != 0) {
+      continue;
+    }
+    key.trans = -1;
+    for (int t = 0; t < 4; t++) {
+      if (strcmp(trans, trans_names[t]) == 0) key.trans = t;
+    }
+    if (key.trans < 0 || config.kc <= 0 || config.nc <= 0 || config.threads <= 0) {
+      continue;
+    }
+    gemm_cache[key] = config;
+  }
+  fclose(file);
+}
+
+static void make_parent_dirs(const std::string& path) {
+  for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+    mkdir(path.substr(0, slash).c_str(), 0755);
+  }
+}
+
+// Expects cache_mutex to be held
+static void append_entry(const GemmKey& key, const GemmConfig& config) {
+  if (cache_path.empty()) {
+    return;
+  }
+  FILE* file = fopen(cache_path.c_str(), "a");
+  if (file == NULL) {
+    make_parent_dirs(cache_path);
+    file = fopen(cache_path.c_str(), "a");
+  }
+  if (file == NULL) {
+    // Not fatal: the result still lives in memory for this process
+    static bool warned = false;
+    if (!warned) {
+      fprintf(stderr, "Could not open autotune cache '%s' for writing\n", cache_path.c_str());
+      warned = true;
+    }
+    return;
+  }
+  write_entry(file, key, config);
+  fclose(file);
+}
+
+static void record(const GemmKey& key, const GemmConfig& config) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  gemm_cache[key] = config;
+  append_entry(key, config);
+}
+
+static double time_gemm(const GemmConfig* config, bool trans_a, bool trans_b, int M, int N, int K,
+                        const float* A, const float* B, float* C) {
+  double best = 1e30;
+  for (int r = 0; r < AUTOTUNE_REPEATS; r++) {
+    auto start = std::chrono::steady_clock::now();
+    gemm_blocked_cpu(config, trans_a, trans_b, M, N, K, 1.0f, A, trans_a ? M : K, B, trans_b ? K : N, 0.0f, C, N);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = elapsed < best ? elapsed : best;
+  }
+  return best;
+}
+
+// Times every candidate on scratch operands of the key's shape and returns
+// the fastest. Blocking only changes which panel of op(B) is live, not the
+// order of the additions into C, so every candidate gives the same result
+static bool tune_gemm(const GemmKey& key, GemmConfig* best) {
+  bool trans_a = key.trans & 1, trans_b = key.trans & 2;
+  int M = key.M, N = key.N, K = key.K;
+  long row_work = (long)N * K;
+  if (row_work > 0 && (long)M * row_work > AUTOTUNE_BENCH_WORK) {
+    long rows = AUTOTUNE_BENCH_WORK / row_work;
+    long min_rows = 4L * key.host_threads;
+    rows = rows > min_rows ? rows : min_rows;
+    M = rows < M ? (int)rows : M;
+  }
+
+  float* A = (float*)malloc(((long)M * K + 1) * sizeof(float));
+  float* B = (float*)malloc(((long)K * N + 1) * sizeof(float));
+  float* C = (float*)malloc(((long)M * N + 1) * sizeof(float));
+  if (A == NULL || B == NULL || C == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    free(A);
+    free(B);
+    free(C);
+    return false;
+  }
+  for (long i = 0; i < (long)M * K; i++) A[i] = (float)(i % 7) * 0.125f;
+  for (long i = 0; i < (long)K * N; i++) B[i] = (float)(i % 5) * 0.25f;
+
+  *best = default_gemm_config();
+  // Warm up (page faults, thread pool) before anything is timed
+  gemm_blocked_cpu(best, trans_a, trans_b, M, N, K, 1.0f, A, trans_a ? M : K, B, trans_b ? K : N, 0.0f, C, N);
+  double best_time = time_gemm(best, trans_a, trans_b, M, N, K, A, B, C);
+
+  // All threads, or half of them when the panels are too small to feed them all
+  for (int threads = key.host_threads; threads >= 1 && threads >= key.host_threads / 2; threads /= 2) {
+    for (size_t i = 0; i < sizeof(gemm_kc_candidates) / sizeof(int); i++) {
+      // Panels deeper than K (or wider than N) all behave alike: try one
+      if (i > 0 && gemm_kc_candidates[i - 1] >= K) break;
+      for (size_t j = 0; j < sizeof(gemm_nc_candidates) / sizeof(int); j++) {
+        if (j > 0 && gemm_nc_candidates[j - 1] >= N) break;
+        GemmConfig candidate = {gemm_kc_candidates[i], gemm_nc_candidates[j], threads};
+        double elapsed = time_gemm(&candidate, trans_a, trans_b, M, N, K, A, B, C);
+        if (elapsed < best_time) {
+          best_time = elapsed;
+          *best = candidate;
+        }
+      }
+    }
+  }
+
+  free(A);
+  free(B);
+  free(C);
+  return true;
+}
+
+GemmConfig gemm_config(bool trans_a, bool trans_b, int M, int N, int K) {
+  GemmConfig config = default_gemm_config();
+  int mode = autotune_mode.load(std::memory_order_relaxed);
+  // Inside a parallel region the GEMM runs on one thread and timings would
+  // compete with the other threads, so nested calls keep the defaults
+  if (mode == AUTOTUNE_OFF || (long)M * N * K < AUTOTUNE_MIN_WORK || in_parallel()) {
+    return config;
+  }
+
+  GemmKey key = gemm_key(trans_a, trans_b, M, N, K);
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto found = gemm_cache.find(key);
+    if (found != gemm_cache.end()) {
+      return found->second;
+    }
+  }
+  if (mode == AUTOTUNE_ONLINE) {
+    // A failed tuning still records the defaults, so it is not retried on every call
+    tune_gemm(key, &config);
+    record(key, config);
+  }
+  return config;
+}
+
+int set_autotune_mode(int mode) {
+  if (mode < AUTOTUNE_OFF || mode > AUTOTUNE_ONLINE) {
+    fprintf(stderr, "Unknown autotune mode %d\n", mode);
+    return -1;
+  }
+  autotune_mode.store(mode);
+  return 0;
+}
+
+int get_autotune_mode() { return autotune_mode.load(); }
+
+int set_autotune_cache_file(const char* path) {
+  // Entries already in memory stay; those in the file are merged over them
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  cache_path = path != NULL ? path : "";
+  if (!cache_path.empty()) {
+    load_cache(cache_path.c_str());
+  }
+  return 0;
+}
+
+int autotune_save(const char* path) {
+  // Rewrites the whole file, dropping duplicate keys left by appends
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  std::string target = path != NULL ? path : cache_path;
+  if (target.empty()) {
+    fprintf(stderr, "No autotune cache file to save to\n");
+    return -1;
+  }
+  std::string temporary = target + ".tmp";
+  make_parent_dirs(target);
+  FILE* file = fopen(temporary.c_str(), "w");
+  if (file == NULL) {
+    fprintf(stderr, "Could not open autotune cache '%s' for writing\n", temporary.c_str());
+    return -1;
+  }
+  fprintf(file, "# op dtype trans M N K host_threads -> kc nc threads\n");
+  for (const auto& entry : gemm_cache) {
+    write_entry(file, entry.first, entry.second);
+  }
+  if (fclose(file) != 0 || rename(temporary.c_str(), target.c_str()) != 0) {
+    fprintf(stderr, "Could not write autotune cache '%s'\n", target.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+void autotune_clear() {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  gemm_cache.clear();
+}
+
+int autotune_gemm(bool trans_a, bool trans_b, int M, int N, int K) {
+  // Offline tuning: measures the shape now whatever the mode or size, replacing any cached entry
+  if (M <= 0 || N <= 0 || K <= 0) {
+    fprintf(stderr, "Cannot tune a GEMM of shape %dx%dx%d\n", M, N, K);
+    return -1;
+  }
+  GemmKey key = gemm_key(trans_a, trans_b, M, N, K);
+  GemmConfig config;
+  if (!tune_gemm(key, &config)) {
+    return -1;
+  }
+  record(key, config);
+  return 0;
+}
+
+int autotune_lookup_gemm(bool trans_a, bool trans_b, int M, int N, int K, GemmConfig* config) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto found = gemm_cache.find(gemm_key(trans_a, trans_b, M, N, K));
+  if (found == gemm_cache.end()) {
+    return 0;
+  }
+  *config = found->second;
+  return 1;
+}
+
+static std::string default_cache_path() {
+  const char* path = getenv("TENSOR_AUTOTUNE_CACHE");
+  if (path != NULL) {
+    return path;
+  }
+  const char* cache_home = getenv("XDG_CACHE_HOME");
+  if (cache_home != NULL && cache_home[0] != '\0') {
+    return std::string(cache_home) + "/tensor_lib/autotune.txt";
+  }
+  const char* home = getenv("HOME");
+  return home != NULL && home[0] != '\0' ? std::string(home) + "/.cache/tensor_lib/autotune.txt" : "";
+}
+
+static bool autotune_init() {
+  const char* mode = getenv("TENSOR_AUTOTUNE");
+  if (mode != NULL) {
+    if (strcmp(mode, "off") == 0) {
+      autotune_mode.store(AUTOTUNE_OFF);
+    } else if (strcmp(mode, "cached") == 0) {
+      autotune_mode.store(AUTOTUNE_CACHED);
+    } else if (strcmp(mode, "online") == 0) {
+      autotune_mode.store(AUTOTUNE_ONLINE);
+    } else {
+      fprintf(stderr, "Unknown TENSOR_AUTOTUNE mode '%s', expected off, cached or online\n", mode);
+    }
+  }
+  std::string path = default_cache_path();
+  set_autotune_cache_file(path.c_str());
+  return true;
+}
+
+// Defined after the cache so it is constructed first: loads the file when the library is loaded
+static bool autotune_loaded = autotune_init();
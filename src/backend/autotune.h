@@ -0,0 +1,40 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+// Measured kernel configurations, keyed by (op, dtype, shape, host thread
+// count). On first sight of a key the candidates are timed on scratch
+// buffers and the fastest is kept; the cache is loaded from a file when the
+// library is loaded and each new result is appended to it.
+//
+// The file is TENSOR_AUTOTUNE_CACHE, else $XDG_CACHE_HOME/tensor_lib/autotune.txt
+// (~/.cache if unset). TENSOR_AUTOTUNE sets the starting mode: off, cached or
+// online.
+#define AUTOTUNE_OFF 0     // always use the built-in defaults
+#define AUTOTUNE_CACHED 1  // use measured configurations, never benchmark (steady state)
+#define AUTOTUNE_ONLINE 2  // also benchmark keys not seen before (default)
+
+// Built-in GEMM blocking, used for untuned keys
+#define GEMM_KC 256
+#define GEMM_NC 512
+
+typedef struct {
+    int kc;       // depth of a packed panel of op(B)
+    int nc;       // width of a packed panel of op(B)
+    int threads;  // OpenMP threads for the panel loops
+} GemmConfig;
+
+// Configuration gemm_cpu should use for this problem, tuning it first if
+// the mode and size call for it
+GemmConfig gemm_config(bool trans_a, bool trans_b, int M, int N, int K);
+
+extern "C" {
+    int set_autotune_mode(int mode);
+    int get_autotune_mode();
+    int set_autotune_cache_file(const char* path);
+    int autotune_save(const char* path);
+    void autotune_clear();
+    int autotune_gemm(bool trans_a, bool trans_b, int M, int N, int K);
+    int autotune_lookup_gemm(bool trans_a, bool trans_b, int M, int N, int K, GemmConfig* config);
+}
+
+#endif
@@ -0,0 +1,1357 @@
+// Native Python binding for the tensor backend.
+//
+// Exposes the C Tensor as the `_backend.TensorHandle` type: the handle owns
+// its Tensor* (freed on dealloc) and every op is a method that calls the
+// backend directly, so a small op costs one method call instead of a round of
+// ctypes argument marshalling. Kernels on large tensors run with the GIL
+// released. The module links against tensor_lib.so, so ctypes users of the
+// same library (sparse, distributed, memory) share its state.
+//
+// A handle may instead be a view (from slice or view): its Tensor shares the
+// data of another handle, which it keeps alive through 'base'.
+//
+// With async execution on (set_async), ops do not run on the calling thread:
+// each is queued on an in-order stream served by one worker thread and
+// returns a pending handle at once, so Python bookkeeping overlaps the
+// kernels. Reading data (item, tolist, buffer export, address) waits for the
+// stream, as do synchronize() and turning async execution off. An op that
+// fails on the stream is reported by the next synchronization.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu.h"
+#include "random.h"
+#include "tensor.h"
+
+// Below this many elements a kernel finishes faster than a GIL handoff
+#define GIL_RELEASE_GRAIN 16384
+
+#define RUN_KERNEL(size, stmt)         \
+  do {                                 \
+    if ((size) >= GIL_RELEASE_GRAIN) { \
+      Py_BEGIN_ALLOW_THREADS stmt;     \
+      Py_END_ALLOW_THREADS             \
+    } else {                           \
+      stmt;                            \
+    }                                  \
+  } while (0)
+
+// Result slot of an op queued in async mode, filled in by the worker
+typedef struct {
+  Tensor* tensor;
+  bool is_view;
+  const char* op;
+} Pending;
+
+typedef struct {
+  PyObject_HEAD
+  Tensor* tensor;    // NULL until the op producing it has run (see 'pending')
+  PyObject* base;    // owner of the data if this handle is a view, else NULL
+  Pending* pending;  // set if the handle was returned by a queued op
+  // Owner the result of a queued slice or view would alias, kept alive until
+  // the op resolves: it then becomes 'base' if the result is a view, else is released
+  PyObject* pending_base;
+} TensorHandle;
+
+static PyTypeObject TensorHandleType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+// Execution stream
+
+struct Stream {
+  std::mutex mutex;
+  std::condition_variable work;  // an op was queued
+  std::condition_variable idle;  // nothing is queued or running
+  std::deque<std::function<void()>> queue;
+  long outstanding = 0;  // queued plus running
+  std::string error;     // first failure since the last synchronization
+  bool started = false;
+};
+
+// Never destroyed: the detached worker may still wait on it at exit
+static Stream* stream = new Stream();
+static bool async_enabled = false;
+
+static void stream_worker() {
+  std::unique_lock<std::mutex> lock(stream->mutex);
+  for (;;) {
+    stream->work.wait(lock, [] { return !stream->queue.empty(); });
+    std::function<void()> task = std::move(stream->queue.front());
+    stream->queue.pop_front();
+    lock.unlock();
+    task();
+    task = nullptr;
+    lock.lock();
+    if (--stream->outstanding == 0) {
+      stream->idle.notify_all();
+    }
+  }
+}
+
+static void stream_enqueue(std::function<void()> task) {
+  std::lock_guard<std::mutex> lock(stream->mutex);
+  if (!stream->started) {
+    std::thread(stream_worker).detach();
+    stream->started = true;
+  }
+  stream->queue.push_back(std::move(task));
+  stream->outstanding++;
+  stream->work.notify_one();
+}
+
+// Called on the worker
+static void stream_fail(const char* op, const char* message) {
+  std::lock_guard<std::mutex> lock(stream->mutex);
+  if (stream->error.empty()) {
+    stream->error = message[0] != '\0' ? message : std::string("Invalid arguments for ") + op;
+  }
+}
+
+// Waits until every queued op has run; raises the first error they hit
+static int stream_synchronize() {
+  if (!stream->started) {
+    return 0;
+  }
+  std::string error;
+  Py_BEGIN_ALLOW_THREADS {
+    std::unique_lock<std::mutex> lock(stream->mutex);
+    stream->idle.wait(lock, [] { return stream->outstanding == 0; });
+    error.swap(stream->error);
+  }
+  Py_END_ALLOW_THREADS
+  if (!error.empty()) {
+    PyErr_SetString(PyExc_RuntimeError, error.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+// Makes self->tensor usable on the calling thread. Reading data needs the
+// whole stream drained ('drain'), since a queued in-place op may write it;
+// metadata only needs the op that produces the handle
+static int sync_handle(TensorHandle* self, bool drain) {
+  if ((drain || self->tensor == NULL) && stream_synchronize() < 0) {
+    return -1;
+  }
+  if (self->tensor == NULL) {
+    if (self->pending->tensor == NULL) {
+      PyErr_Format(PyExc_ValueError, "Invalid arguments for %s", self->pending->op);
+      return -1;
+    }
+    self->tensor = self->pending->tensor;
+    if (self->pending_base != NULL) {
+      PyObject* owner = self->pending_base;
+      self->pending_base = NULL;
+      TensorHandle* handle = (TensorHandle*)owner;
+      if (!self->pending->is_view) {
+        Py_DECREF(owner);
+      } else if (sync_handle(handle, false) == 0 && handle->base != NULL) {
+        // The owner was itself a queued view: point at the handle owning the data
+        self->base = handle->base;
+        Py_INCREF(self->base);
+        Py_DECREF(owner);
+      } else {
+        self->base = owner;
+      }
+    }
+  }
+  return 0;
+}
+
+// An op input: a ready tensor or the slot of a queued op. The stream runs ops
+// in order, so a producer has always finished when its consumers run
+typedef struct {
+  Tensor* tensor;
+  Pending* pending;
+} Ref;
+
+static inline Ref ref_of(TensorHandle* handle) {
+  Ref ref = {handle->tensor, handle->pending};
+  return ref;
+}
+
+static inline Tensor* resolve(Ref ref) { return ref.tensor != NULL ? ref.tensor : ref.pending->tensor; }
+
+// Filled in by an op body: whether the result aliases its input and, on
+// failure, what went wrong. Bodies may run on the worker, so they report
+// errors here rather than through the Python error state
+typedef struct {
+  bool is_view;
+  char message[256];
+} OpStatus;
+
+static Tensor* op_error(OpStatus* status, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(status->message, sizeof(status->message), format, args);
+  va_end(args);
+  return NULL;
+}
+
+static TensorHandle* unwrap(PyObject* obj, const char* op) {
+  if (!PyObject_TypeCheck(obj, &TensorHandleType)) {
+    PyErr_Format(PyExc_TypeError, "%s expects a TensorHandle, got '%s'", op, Py_TYPE(obj)->tp_name);
+    return NULL;
+  }
+  return (TensorHandle*)obj;
+}
+
+// Results take the type of the handle they were computed from, so a Python
+// subclass of TensorHandle propagates through every op
+static PyObject* wrap(PyTypeObject* type, Tensor* tensor, const char* op) {
+  if (tensor == NULL) {
+    if (!PyErr_Occurred()) {
+      PyErr_Format(PyExc_ValueError, "Invalid arguments for %s", op);
+    }
+    return NULL;
+  }
+  TensorHandle* self = (TensorHandle*)type->tp_alloc(type, 0);
+  if (self == NULL) {
+    free_tensor(tensor);
+    return NULL;
+  }
+  self->tensor = tensor;
+  self->base = NULL;
+  return (PyObject*)self;
+}
+
+// Views of views point at the handle that owns the data. 'base' is only set
+// once a handle is known to be a view; an unresolved queued result pins
+// itself, and through its pending_base whatever it may turn out to alias
+static PyObject* data_owner(TensorHandle* self) { return self->base != NULL ? self->base : (PyObject*)self; }
+
+static PyObject* wrap_view(TensorHandle* base, Tensor* tensor, const char* op) {
+  if (tensor == NULL) {
+    if (!PyErr_Occurred()) {
+      PyErr_Format(PyExc_ValueError, "Invalid arguments for %s", op);
+    }
+    return NULL;
+  }
+  TensorHandle* self = (TensorHandle*)Py_TYPE(base)->tp_alloc(Py_TYPE(base), 0);
+  if (self == NULL) {
+    free_tensor_view(tensor);
+    return NULL;
+  }
+  self->tensor = tensor;
+  self->base = data_owner(base);
+  Py_INCREF(self->base);
+  return (PyObject*)self;
+}
+
+static bool check_inputs(std::initializer_list<Ref> inputs, long* size, const char* op) {
+  *size = 0;
+  for (Ref ref : inputs) {
+    Tensor* tensor = resolve(ref);
+    if (tensor == NULL) {
+      PyErr_Format(PyExc_ValueError, "Invalid arguments for %s: an input failed to compute", op);
+      return false;
+    }
+    *size += tensor->size;
+  }
+  return true;
+}
+
+// Runs an op that returns a new tensor: right away (GIL released for large
+// inputs) or, in async mode, queued on the stream behind a pending handle.
+// body(OpStatus*) resolves its Refs and calls the backend
+template <typename Body>
+static PyObject* launch(TensorHandle* self, const char* op, std::initializer_list<Ref> inputs, Body body,
+                        bool may_view = false) {
+  if (!async_enabled) {
+    long size;
+    if (!check_inputs(inputs, &size, op)) {
+      return NULL;
+    }
+    OpStatus status = {false, ""};
+    Tensor* result;
+    RUN_KERNEL(size, result = body(&status));
+    if (result == NULL && status.message[0] != '\0') {
+      PyErr_SetString(PyExc_ValueError, status.message);
+    }
+    return status.is_view ? wrap_view(self, result, op) : wrap(Py_TYPE(self), result, op);
+  }
+
+  TensorHandle* handle = (TensorHandle*)Py_TYPE(self)->tp_alloc(Py_TYPE(self), 0);
+  if (handle == NULL) {
+    return NULL;
+  }
+  Pending* pending = new Pending{NULL, false, op};
+  handle->pending = pending;
+  if (may_view) {
+    // Whether the result is a view is only known once it has run (see sync_handle)
+    handle->pending_base = data_owner(self);
+    Py_INCREF(handle->pending_base);
+  }
+  std::vector<Ref> refs(inputs);
+  stream_enqueue([pending, refs, body, op]() {
+    for (Ref ref : refs) {
+      if (resolve(ref) == NULL) {
+        return;  // the op that failed has already been reported
+      }
+    }
+    OpStatus status = {false, ""};
+    pending->tensor = body(&status);
+    pending->is_view = status.is_view;
+    if (pending->tensor == NULL) {
+      stream_fail(op, status.message);
+    }
+  });
+  return (PyObject*)handle;
+}
+
+// Same for ops that write one of their inputs in place; body returns success
+template <typename Body>
+static PyObject* launch_inplace(const char* op, std::initializer_list<Ref> inputs, Body body) {
+  if (!async_enabled) {
+    long size;
+    if (!check_inputs(inputs, &size, op)) {
+      return NULL;
+    }
+    OpStatus status = {false, ""};
+    bool ok;
+    RUN_KERNEL(size, ok = body(&status));
+    if (!ok) {
+      PyErr_SetString(PyExc_ValueError, status.message[0] != '\0' ? status.message : "Invalid arguments");
+      return NULL;
+    }
+    Py_RETURN_NONE;
+  }
+
+  std::vector<Ref> refs(inputs);
+  stream_enqueue([refs, body, op]() {
+    for (Ref ref : refs) {
+      if (resolve(ref) == NULL) {
+        return;
+      }
+    }
+    OpStatus status = {false, ""};
+    if (!body(&status)) {
+      stream_fail(op, status.message);
+    }
+  });
+  Py_RETURN_NONE;
+}
+
+static int parse_ints(PyObject* seq, int* out, int max_len, const char* op) {
+  PyObject* fast = PySequence_Fast(seq, op);
+  if (fast == NULL) {
+    return -1;
+  }
+  Py_ssize_t n = PySequence_Fast_GET_SIZE(fast);
+  if (n > max_len) {
+    PyErr_Format(PyExc_ValueError, "%s supports at most %d dimensions (got %zd)", op, max_len, n);
+    Py_DECREF(fast);
+    return -1;
+  }
+  PyObject** items = PySequence_Fast_ITEMS(fast);
+  for (Py_ssize_t i = 0; i < n; i++) {
+    out[i] = (int)PyLong_AsLong(items[i]);
+    if (out[i] == -1 && PyErr_Occurred()) {
+      Py_DECREF(fast);
+      return -1;
+    }
+  }
+  Py_DECREF(fast);
+  return (int)n;
+}
+
+// Shape arguments are copied into the op body, which may outlive the call
+typedef struct {
+  int value[TENSOR_MAX_DIMS];
+  int count;
+} Dims;
+
+static int parse_dims(PyObject* seq, Dims* dims, const char* op) {
+  dims->count = parse_ints(seq, dims->value, TENSOR_MAX_DIMS, op);
+  return dims->count < 0 ? -1 : 0;
+}
+
+// Integer indices for the index ops: a TensorHandle holding whole numbers
+// (its shape is kept), a buffer of C ints or longs (e.g. a numpy array) or a
+// flat sequence of ints. 'data' is shared with the op body, which may run
+// after the call returns
+typedef struct {
+  std::shared_ptr<int> data;
+  long count;
+  int shape[TENSOR_MAX_DIMS];
+  int ndim;
+} IndexArray;
+
+static int* allocate_index(IndexArray* index, long count) {
+  int* data = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+  if (data == NULL) {
+    PyErr_NoMemory();
+    return NULL;
+  }
+  index->data = std::shared_ptr<int>(data, free);
+  index->count = count;
+  return data;
+}
+
+static int parse_index(PyObject* obj, IndexArray* index, const char* op) {
+  if (PyObject_TypeCheck(obj, &TensorHandleType)) {
+    if (sync_handle((TensorHandle*)obj, true) < 0) {
+      return -1;
+    }
+    Tensor* t = ((TensorHandle*)obj)->tensor;
+    int* data = allocate_index(index, t->size);
+    if (data == NULL) {
+      return -1;
+    }
+    index->ndim = t->ndim;
+    memcpy(index->shape, t->shape, t->ndim * sizeof(int));
+    for (long i = 0; i < t->size; i++) {
+      data[i] = (int)t->data[i];
+      if ((float)data[i] != t->data[i]) {
+        PyErr_Format(PyExc_ValueError, "%s index %g is not a whole number", op, t->data[i]);
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  if (PyObject_CheckBuffer(obj)) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(obj, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0) {
+      return -1;
+    }
+    const char* format = view.format[0] == '@' || view.format[0] == '=' ? view.format + 1 : view.format;
+    bool is_int = view.itemsize == sizeof(int) && strcmp(format, "i") == 0;
+    bool is_long = view.itemsize == 8 && (strcmp(format, "l") == 0 || strcmp(format, "q") == 0);
+    if ((!is_int && !is_long) || view.ndim != 1) {
+      PyErr_Format(PyExc_TypeError, "%s index buffer must be 1D int32 or int64 (got '%s', %d dims)", op,
+                   view.format, view.ndim);
+      PyBuffer_Release(&view);
+      return -1;
+    }
+    int* data = allocate_index(index, view.shape[0]);
+    if (data == NULL) {
+      PyBuffer_Release(&view);
+      return -1;
+    }
+    index->ndim = 1;
+    index->shape[0] = (int)view.shape[0];
+    for (long i = 0; i < index->count; i++) {
+      data[i] = is_int ? ((const int*)view.buf)[i] : (int)((const long long*)view.buf)[i];
+    }
+    PyBuffer_Release(&view);
+    return 0;
+  }
+
+  PyObject* fast = PySequence_Fast(obj, op);
+  if (fast == NULL) {
+    return -1;
+  }
+  int* data = allocate_index(index, PySequence_Fast_GET_SIZE(fast));
+  if (data == NULL) {
+    Py_DECREF(fast);
+    return -1;
+  }
+  index->ndim = 1;
+  index->shape[0] = (int)index->count;
+  PyObject** items = PySequence_Fast_ITEMS(fast);
+  for (long i = 0; i < index->count; i++) {
+    data[i] = (int)PyLong_AsLong(items[i]);
+    if (data[i] == -1 && PyErr_Occurred()) {
+      Py_DECREF(fast);
+      return -1;
+    }
+  }
+  Py_DECREF(fast);
+  return 0;
+}
+
+static PyObject* handle_new(PyTypeObject* type, PyObject* args, PyObject* kwds) {
+  PyObject* data;
+  PyObject* shape_obj;
+  static const char* kwlist[] = {"data", "shape", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO", (char**)kwlist, &data, &shape_obj)) {
+    return NULL;
+  }
+
+  int shape[TENSOR_MAX_DIMS];
+  int ndim = parse_ints(shape_obj, shape, TENSOR_MAX_DIMS, "TensorHandle shape");
+  if (ndim < 0) {
+    return NULL;
+  }
+  if (ndim == 0) {
+    PyErr_SetString(PyExc_ValueError, "TensorHandle shape must have at least one dimension");
+    return NULL;
+  }
+
+  PyObject* fast = PySequence_Fast(data, "TensorHandle data must be a sequence of numbers");
+  if (fast == NULL) {
+    return NULL;
+  }
+  long size = 1;
+  for (int i = 0; i < ndim; i++) {
+    size *= shape[i];
+  }
+  if (PySequence_Fast_GET_SIZE(fast) != size) {
+    PyErr_Format(PyExc_ValueError, "TensorHandle got %zd values for a shape of %ld elements",
+                 PySequence_Fast_GET_SIZE(fast), size);
+    Py_DECREF(fast);
+    return NULL;
+  }
+
+  // Converted under the GIL into a scratch buffer, then copied by
+  // create_tensor so large tensors get the parallel first touch
+  float* values = (float*)malloc(size * sizeof(float));
+  if (values == NULL) {
+    Py_DECREF(fast);
+    return PyErr_NoMemory();
+  }
+  PyObject** items = PySequence_Fast_ITEMS(fast);
+  for (long i = 0; i < size; i++) {
+    double value = PyFloat_AsDouble(items[i]);
+    if (value == -1.0 && PyErr_Occurred()) {
+      free(values);
+      Py_DECREF(fast);
+      return NULL;
+    }
+    values[i] = (float)value;
+  }
+  Py_DECREF(fast);
+
+  Tensor* tensor;
+  RUN_KERNEL(size, tensor = create_tensor(values, shape, ndim));
+  free(values);
+  if (tensor == NULL) {
+    return PyErr_NoMemory();
+  }
+
+  return wrap(type, tensor, "TensorHandle");
+}
+
+static void release_tensor(Tensor* tensor, Pending* pending, bool is_view) {
+  if (pending != NULL) {
+    tensor = pending->tensor;
+    is_view = pending->is_view;
+    delete pending;
+  }
+  if (is_view) {
+    free_tensor_view(tensor);
+  } else {
+    free_tensor(tensor);
+  }
+}
+
+static void handle_dealloc(TensorHandle* self) {
+  Tensor* tensor = self->tensor;
+  Pending* pending = self->pending;
+  bool is_view = self->base != NULL;  // only used when there is no pending slot
+  if (async_enabled) {
+    // Queued ops may still use the tensor: free it after them
+    stream_enqueue([tensor, pending, is_view]() { release_tensor(tensor, pending, is_view); });
+  } else {
+    release_tensor(tensor, pending, is_view);
+  }
+  // The owner's own release is queued behind every op that used this view
+  Py_XDECREF(self->base);
+  Py_XDECREF(self->pending_base);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* handle_from_address(PyObject* cls, PyObject* arg) {
+  // ctypes returns a null c_void_p as None
+  Tensor* tensor = arg == Py_None ? NULL : (Tensor*)PyLong_AsVoidPtr(arg);
+  if (tensor == NULL) {
+    if (!PyErr_Occurred()) {
+      PyErr_SetString(PyExc_ValueError, "from_address got a null Tensor pointer");
+    }
+    return NULL;
+  }
+  return wrap((PyTypeObject*)cls, tensor, "from_address");
+}
+
+static PyObject* handle_empty(PyObject* cls, PyObject* arg) {
+  int shape[TENSOR_MAX_DIMS];
+  int ndim = parse_ints(arg, shape, TENSOR_MAX_DIMS, "empty");
+  if (ndim < 0) {
+    return NULL;
+  }
+  if (ndim == 0) {
+    PyErr_SetString(PyExc_ValueError, "empty shape must have at least one dimension");
+    return NULL;
+  }
+  // Left unwritten so the first (parallel) fill decides page placement
+  return wrap((PyTypeObject*)cls, allocate_tensor(shape, ndim), "empty");
+}
+
+static PyObject* handle_get_shape(TensorHandle* self, void*) {
+  if (sync_handle(self, false) < 0) {
+    return NULL;
+  }
+  PyObject* shape = PyList_New(self->tensor->ndim);
+  if (shape == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < self->tensor->ndim; i++) {
+    PyList_SET_ITEM(shape, i, PyLong_FromLong(self->tensor->shape[i]));
+  }
+  return shape;
+}
+
+static PyObject* handle_get_ndim(TensorHandle* self, void*) {
+  if (sync_handle(self, false) < 0) {
+    return NULL;
+  }
+  return PyLong_FromLong(self->tensor->ndim);
+}
+
+static PyObject* handle_get_size(TensorHandle* self, void*) {
+  if (sync_handle(self, false) < 0) {
+    return NULL;
+  }
+  return PyLong_FromLong(self->tensor->size);
+}
+
+static PyObject* handle_get_address(TensorHandle* self, void*) {
+  // The caller may read or write the data through the pointer
+  if (sync_handle(self, true) < 0) {
+    return NULL;
+  }
+  return PyLong_FromVoidPtr(self->tensor);
+}
+
+static PyObject* handle_get_base(TensorHandle* self, void*) {
+  if (sync_handle(self, false) < 0) {
+    return NULL;
+  }
+  PyObject* base = self->base != NULL ? self->base : Py_None;
+  Py_INCREF(base);
+  return base;
+}
+
+static PyObject* handle_item(TensorHandle* self, PyObject* arg) {
+  int indices[TENSOR_MAX_DIMS];
+  int n;
+  if (PyLong_Check(arg)) {
+    indices[0] = (int)PyLong_AsLong(arg);
+    n = 1;
+  } else {
+    n = parse_ints(arg, indices, TENSOR_MAX_DIMS, "item");
+  }
+  if (n < 0 || sync_handle(self, true) < 0) {
+    return NULL;
+  }
+  if (n != self->tensor->ndim) {
+    PyErr_SetString(PyExc_ValueError, "Number of indices must match the number of dimensions");
+    return NULL;
+  }
+  for (int i = 0; i < n; i++) {
+    if (indices[i] < 0 || indices[i] >= self->tensor->shape[i]) {
+      PyErr_Format(PyExc_IndexError, "index %d is out of bounds for dimension %d with size %d", indices[i], i,
+                   self->tensor->shape[i]);
+      return NULL;
+    }
+  }
+  return PyFloat_FromDouble(get_element(self->tensor, indices));
+}
+
+static PyObject* handle_tolist(TensorHandle* self, PyObject*) {
+  if (sync_handle(self, true) < 0) {
+    return NULL;
+  }
+  PyObject* list = PyList_New(self->tensor->size);
+  if (list == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < self->tensor->size; i++) {
+    PyList_SET_ITEM(list, i, PyFloat_FromDouble(self->tensor->data[i]));
+  }
+  return list;
+}
+
+// Element-wise and shape ops
+
+#define BINARY_OP(name, fn)                                                                    \
+  static PyObject* handle_##name(TensorHandle* self, PyObject* arg) {                          \
+    TensorHandle* other = unwrap(arg, #name);                                                  \
+    if (other == NULL) {                                                                       \
+      return NULL;                                                                             \
+    }                                                                                          \
+    Ref a = ref_of(self), b = ref_of(other);                                                   \
+    return launch(self, #name, {a, b}, [=](OpStatus*) { return fn(resolve(a), resolve(b)); }); \
+  }
+
+#define UNARY_OP(name, fn)                                                       \
+  static PyObject* handle_##name(TensorHandle* self, PyObject*) {                \
+    Ref a = ref_of(self);                                                        \
+    return launch(self, #name, {a}, [=](OpStatus*) { return fn(resolve(a)); }); \
+  }
+
+#define SCALAR_OP(name, expr)                                         \
+  static PyObject* handle_##name(TensorHandle* self, PyObject* arg) { \
+    float scalar = (float)PyFloat_AsDouble(arg);                      \
+    if (scalar == -1.0f && PyErr_Occurred()) {                        \
+      return NULL;                                                    \
+    }                                                                 \
+    Ref a = ref_of(self);                                             \
+    return launch(self, #name, {a}, [=](OpStatus*) {                  \
+      Tensor* t = resolve(a);                                         \
+      return expr;                                                    \
+    });                                                               \
+  }
+
+BINARY_OP(add, add_tensor)
+BINARY_OP(sub, sub_tensor)
+BINARY_OP(mul, elementwise_mul_tensor)
+BINARY_OP(div, tensor_div_tensor)
+UNARY_OP(copy, assign_tensor)
+UNARY_OP(ones_like, ones_like_tensor)
+UNARY_OP(zeros_like, zeros_like_tensor)
+UNARY_OP(T, transpose_tensor)
+UNARY_OP(sigmoid, sigmoid_tensor)
+UNARY_OP(log, log_tensor)
+UNARY_OP(conv2d_backward_bias, conv2d_backward_bias_tensor)
+SCALAR_OP(scalar_mul, scalar_mul_tensor(t, scalar))
+SCALAR_OP(div_scalar, tensor_div_scalar(t, scalar))
+SCALAR_OP(pow_scalar, tensor_pow_scalar(t, scalar))
+SCALAR_OP(scalar_pow, scalar_pow_tensor(scalar, t))
+
+static PyObject* handle_reshape(TensorHandle* self, PyObject* arg) {
+  Dims shape;
+  if (parse_dims(arg, &shape, "reshape") < 0) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  return launch(self, "reshape", {a}, [=](OpStatus*) {
+    Dims s = shape;
+    return reshape_tensor(resolve(a), s.value, s.count);
+  });
+}
+
+static PyObject* handle_permute(TensorHandle* self, PyObject* arg) {
+  Dims dims;
+  if (parse_dims(arg, &dims, "permute") < 0) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  return launch(self, "permute", {a}, [=](OpStatus* status) {
+    Tensor* t = resolve(a);
+    if (dims.count != t->ndim) {
+      return op_error(status, "permute got %d dims for a %dD tensor", dims.count, t->ndim);
+    }
+    return permute_tensor(t, dims.value);
+  });
+}
+
+static PyObject* handle_transpose(TensorHandle* self, PyObject* args) {
+  int axis1, axis2;
+  if (!PyArg_ParseTuple(args, "ii", &axis1, &axis2)) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  return launch(self, "transpose", {a},
+                [=](OpStatus*) { return transpose_axes_tensor(resolve(a), axis1, axis2); });
+}
+
+static PyObject* handle_sum(TensorHandle* self, PyObject* args) {
+  int axis = -1;
+  int keepdim = 0;
+  if (!PyArg_ParseTuple(args, "|ip", &axis, &keepdim)) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  return launch(self, "sum", {a}, [=](OpStatus* status) {
+    Tensor* t = resolve(a);
+    if (axis < -1 || axis >= t->ndim) {
+      return op_error(status, "sum axis %d is out of range for a %dD tensor", axis, t->ndim);
+    }
+    return sum_tensor(t, axis, keepdim);
+  });
+}
+
+// Slicing and indexing
+
+static PyObject* handle_view(TensorHandle* self, PyObject* arg) {
+  Dims shape;
+  if (parse_dims(arg, &shape, "view") < 0) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  return launch(self, "view", {a}, [=](OpStatus* status) {
+    status->is_view = true;
+    return view_tensor(resolve(a), shape.value, shape.count);
+  }, true);
+}
+
+// Per-dim start, step and length of a slice, one list each
+typedef struct {
+  Dims start;
+  Dims step;
+  Dims shape;
+} SliceArgs;
+
+static int parse_slice(PyObject* start, PyObject* step, PyObject* shape, SliceArgs* slice, const char* op) {
+  if (parse_dims(start, &slice->start, op) < 0 || parse_dims(step, &slice->step, op) < 0 ||
+      parse_dims(shape, &slice->shape, op) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+static bool check_slice(const SliceArgs& slice, const Tensor* t, OpStatus* status, const char* op) {
+  if (slice.start.count != t->ndim || slice.step.count != t->ndim || slice.shape.count != t->ndim) {
+    op_error(status, "%s expects start, step and shape for each of %d dimensions", op, t->ndim);
+    return false;
+  }
+  return true;
+}
+
+static PyObject* handle_slice(TensorHandle* self, PyObject* args) {
+  // An optional out_shape gives the result's shape, e.g. without the dims
+  // that were indexed by an integer
+  PyObject *start_obj, *step_obj, *shape_obj, *out_shape_obj = NULL;
+  if (!PyArg_ParseTuple(args, "OOO|O", &start_obj, &step_obj, &shape_obj, &out_shape_obj)) {
+    return NULL;
+  }
+  SliceArgs slice;
+  Dims out_shape;
+  if (parse_slice(start_obj, step_obj, shape_obj, &slice, "slice") < 0) {
+    return NULL;
+  }
+  if (out_shape_obj == NULL) {
+    out_shape = slice.shape;
+  } else if (parse_dims(out_shape_obj, &out_shape, "slice") < 0) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  return launch(self, "slice", {a}, [=](OpStatus* status) {
+    Tensor* t = resolve(a);
+    if (!check_slice(slice, t, status, "slice")) {
+      return (Tensor*)NULL;
+    }
+    return slice_tensor(t, slice.start.value, slice.step.value, slice.shape.value, out_shape.value,
+                        out_shape.count, &status->is_view);
+  }, true);
+}
+
+static PyObject* handle_slice_backward(TensorHandle* self, PyObject* args) {
+  // self is the gradient of the slice; 'shape' is the shape of the sliced input
+  PyObject *start_obj, *step_obj, *shape_obj;
+  if (!PyArg_ParseTuple(args, "OOO", &start_obj, &step_obj, &shape_obj)) {
+    return NULL;
+  }
+  SliceArgs slice;
+  if (parse_slice(start_obj, step_obj, shape_obj, &slice, "slice_backward") < 0) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  return launch(self, "slice_backward", {a}, [=](OpStatus* status) {
+    Tensor* t = resolve(a);
+    if (!check_slice(slice, t, status, "slice_backward")) {
+      return (Tensor*)NULL;
+    }
+    return slice_backward_tensor(t, slice.shape.value, slice.start.value, slice.step.value);
+  });
+}
+
+static PyObject* handle_index_select(TensorHandle* self, PyObject* args) {
+  int dim;
+  PyObject* index_obj;
+  IndexArray index;
+  if (!PyArg_ParseTuple(args, "iO", &dim, &index_obj) || parse_index(index_obj, &index, "index_select") < 0) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  std::shared_ptr<int> indices = index.data;
+  int count = (int)index.count;
+  return launch(self, "index_select", {a},
+                [=](OpStatus*) { return index_select_tensor(resolve(a), dim, indices.get(), count); });
+}
+
+static PyObject* handle_index_select_backward(TensorHandle* self, PyObject* args) {
+  int dim, dim_size;
+  PyObject* index_obj;
+  IndexArray index;
+  if (!PyArg_ParseTuple(args, "iOi", &dim, &index_obj, &dim_size) ||
+      parse_index(index_obj, &index, "index_select_backward") < 0) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  std::shared_ptr<int> indices = index.data;
+  int count = (int)index.count;
+  return launch(self, "index_select_backward", {a}, [=](OpStatus*) {
+    return index_select_backward_tensor(resolve(a), dim, indices.get(), count, dim_size);
+  });
+}
+
+// gather and scatter_add need an index with the dimensions of the tensor,
+// and (gather_backward, scatter_add) the shape of the values it places
+static bool check_nd_index(const IndexArray& index, const Tensor* t, const Tensor* like, OpStatus* status,
+                           const char* op) {
+  if (index.ndim != t->ndim) {
+    op_error(status, "%s index has %d dimensions, expected %d", op, index.ndim, t->ndim);
+    return false;
+  }
+  if (like != NULL &&
+      (like->ndim != index.ndim || memcmp(index.shape, like->shape, index.ndim * sizeof(int)) != 0)) {
+    op_error(status, "%s index must have the shape of the %s", op, like == t ? "gradient" : "source");
+    return false;
+  }
+  return true;
+}
+
+static PyObject* handle_gather(TensorHandle* self, PyObject* args) {
+  int dim;
+  PyObject* index_obj;
+  IndexArray index;
+  if (!PyArg_ParseTuple(args, "iO", &dim, &index_obj) || parse_index(index_obj, &index, "gather") < 0) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  return launch(self, "gather", {a}, [=](OpStatus* status) {
+    Tensor* t = resolve(a);
+    if (!check_nd_index(index, t, NULL, status, "gather")) {
+      return (Tensor*)NULL;
+    }
+    return gather_tensor(t, dim, index.data.get(), index.shape);
+  });
+}
+
+static PyObject* handle_gather_backward(TensorHandle* self, PyObject* args) {
+  int dim, dim_size;
+  PyObject* index_obj;
+  IndexArray index;
+  if (!PyArg_ParseTuple(args, "iOi", &dim, &index_obj, &dim_size) ||
+      parse_index(index_obj, &index, "gather_backward") < 0) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  return launch(self, "gather_backward", {a}, [=](OpStatus* status) {
+    Tensor* t = resolve(a);
+    if (!check_nd_index(index, t, t, status, "gather_backward")) {
+      return (Tensor*)NULL;
+    }
+    return gather_backward_tensor(t, dim, index.data.get(), dim_size);
+  });
+}
+
+static PyObject* handle_scatter_add(TensorHandle* self, PyObject* args) {
+  int dim;
+  PyObject *index_obj, *src_obj;
+  IndexArray index;
+  if (!PyArg_ParseTuple(args, "iOO", &dim, &index_obj, &src_obj)) {
+    return NULL;
+  }
+  TensorHandle* src = unwrap(src_obj, "scatter_add");
+  if (src == NULL || parse_index(index_obj, &index, "scatter_add") < 0) {
+    return NULL;
+  }
+  Ref a = ref_of(self), b = ref_of(src);
+  return launch(self, "scatter_add", {a, b}, [=](OpStatus* status) {
+    Tensor* t = resolve(a);
+    Tensor* s = resolve(b);
+    if (!check_nd_index(index, t, s, status, "scatter_add")) {
+      return (Tensor*)NULL;
+    }
+    return scatter_add_tensor(t, dim, index.data.get(), s);
+  });
+}
+
+// Matrix products
+
+static PyObject* handle_matmul(TensorHandle* self, PyObject* args) {
+  PyObject* other_obj;
+  int trans_a = 0, trans_b = 0;
+  if (!PyArg_ParseTuple(args, "O|pp", &other_obj, &trans_a, &trans_b)) {
+    return NULL;
+  }
+  TensorHandle* other = unwrap(other_obj, "matmul");
+  if (other == NULL) {
+    return NULL;
+  }
+  Ref a = ref_of(self), b = ref_of(other);
+  return launch(self, "matmul", {a, b},
+                [=](OpStatus*) { return batched_matmul_tensor(resolve(a), resolve(b), trans_a, trans_b); });
+}
+
+static PyObject* handle_matmul_accumulate(TensorHandle* self, PyObject* args) {
+  PyObject *a_obj, *b_obj;
+  int trans_a = 0, trans_b = 0;
+  float alpha = 1.0f, beta = 1.0f;
+  if (!PyArg_ParseTuple(args, "OO|ppff", &a_obj, &b_obj, &trans_a, &trans_b, &alpha, &beta)) {
+    return NULL;
+  }
+  TensorHandle* a_handle = unwrap(a_obj, "matmul_accumulate");
+  TensorHandle* b_handle = unwrap(b_obj, "matmul_accumulate");
+  if (a_handle == NULL || b_handle == NULL) {
+    return NULL;
+  }
+  Ref a = ref_of(a_handle), b = ref_of(b_handle), c = ref_of(self);
+  return launch_inplace("matmul_accumulate", {a, b, c}, [=](OpStatus* status) {
+    if (matmul_accumulate_tensor(resolve(a), resolve(b), trans_a, trans_b, alpha, beta, resolve(c)) != 0) {
+      op_error(status, "Incompatible shapes for matrix multiplication");
+      return false;
+    }
+    return true;
+  });
+}
+
+// Random fills and dropout
+
+static PyObject* handle_uniform_(TensorHandle* self, PyObject* args) {
+  float low = 0.0f, high = 1.0f;
+  if (!PyArg_ParseTuple(args, "|ff", &low, &high)) {
+    return NULL;
+  }
+  // The counter range is claimed in call order, so a queued fill draws the
+  // same values as it would inline
+  if (sync_handle(self, false) < 0) {
+    return NULL;
+  }
+  unsigned long long seed, offset;
+  random_reserve(self->tensor->size, &seed, &offset);
+  Ref a = ref_of(self);
+  return launch_inplace("uniform_", {a}, [=](OpStatus*) {
+    uniform_fill_tensor(resolve(a), low, high, seed, offset);
+    return true;
+  });
+}
+
+static PyObject* handle_normal_(TensorHandle* self, PyObject* args) {
+  float mean = 0.0f, std = 1.0f;
+  if (!PyArg_ParseTuple(args, "|ff", &mean, &std)) {
+    return NULL;
+  }
+  if (sync_handle(self, false) < 0) {
+    return NULL;
+  }
+  unsigned long long seed, offset;
+  random_reserve(self->tensor->size, &seed, &offset);
+  Ref a = ref_of(self);
+  return launch_inplace("normal_", {a}, [=](OpStatus*) {
+    normal_fill_tensor(resolve(a), mean, std, seed, offset);
+    return true;
+  });
+}
+
+static PyObject* handle_dropout(TensorHandle* self, PyObject* args) {
+  float p;
+  unsigned long long seed, offset;
+  if (!PyArg_ParseTuple(args, "fKK", &p, &seed, &offset)) {
+    return NULL;
+  }
+  Ref a = ref_of(self);
+  return launch(self, "dropout", {a}, [=](OpStatus*) { return dropout_tensor(resolve(a), p, seed, offset); });
+}
+
+// Convolution and pooling
+
+typedef Tensor* (*Conv2dBackwardFn)(Tensor*, Tensor*, Tensor*, int, int, int, int, int, int, int);
+typedef Tensor* (*Pool2dFn)(Tensor*, int, int, int, int, int, int);
+typedef Tensor* (*Pool2dBackwardFn)(Tensor*, Tensor*, int, int, int, int, int, int);
+
+static PyObject* handle_conv2d(TensorHandle* self, PyObject* args) {
+  PyObject *weight_obj, *bias_obj;
+  int sh, sw, ph, pw, dh, dw, groups;
+  if (!PyArg_ParseTuple(args, "OOiiiiiii", &weight_obj, &bias_obj, &sh, &sw, &ph, &pw, &dh, &dw, &groups)) {
+    return NULL;
+  }
+  TensorHandle* weight = unwrap(weight_obj, "conv2d");
+  if (weight == NULL) {
+    return NULL;
+  }
+  Ref x = ref_of(self), w = ref_of(weight);
+  if (bias_obj == Py_None) {
+    return launch(self, "conv2d", {x, w}, [=](OpStatus*) {
+      return conv2d_tensor(resolve(x), resolve(w), NULL, sh, sw, ph, pw, dh, dw, groups);
+    });
+  }
+  TensorHandle* bias = unwrap(bias_obj, "conv2d");
+  if (bias == NULL) {
+    return NULL;
+  }
+  Ref b = ref_of(bias);
+  return launch(self, "conv2d", {x, w, b}, [=](OpStatus*) {
+    return conv2d_tensor(resolve(x), resolve(w), resolve(b), sh, sw, ph, pw, dh, dw, groups);
+  });
+}
+
+static PyObject* conv2d_backward(TensorHandle* self, PyObject* args, Conv2dBackwardFn fn, const char* op) {
+  PyObject *input_obj, *weight_obj;
+  int sh, sw, ph, pw, dh, dw, groups;
+  if (!PyArg_ParseTuple(args, "OOiiiiiii", &input_obj, &weight_obj, &sh, &sw, &ph, &pw, &dh, &dw, &groups)) {
+    return NULL;
+  }
+  TensorHandle* input = unwrap(input_obj, op);
+  TensorHandle* weight = unwrap(weight_obj, op);
+  if (input == NULL || weight == NULL) {
+    return NULL;
+  }
+  Ref g = ref_of(self), x = ref_of(input), w = ref_of(weight);
+  return launch(self, op, {g, x, w}, [=](OpStatus*) {
+    return fn(resolve(g), resolve(x), resolve(w), sh, sw, ph, pw, dh, dw, groups);
+  });
+}
+
+static PyObject* handle_conv2d_backward_input(TensorHandle* self, PyObject* args) {
+  return conv2d_backward(self, args, conv2d_backward_input_tensor, "conv2d_backward_input");
+}
+
+static PyObject* handle_conv2d_backward_weight(TensorHandle* self, PyObject* args) {
+  return conv2d_backward(self, args, conv2d_backward_weight_tensor, "conv2d_backward_weight");
+}
+
+static PyObject* pool2d(TensorHandle* self, PyObject* args, Pool2dFn fn, const char* op) {
+  int kh, kw, sh, sw, ph, pw;
+  if (!PyArg_ParseTuple(args, "iiiiii", &kh, &kw, &sh, &sw, &ph, &pw)) {
+    return NULL;
+  }
+  Ref x = ref_of(self);
+  return launch(self, op, {x}, [=](OpStatus*) { return fn(resolve(x), kh, kw, sh, sw, ph, pw); });
+}
+
+static PyObject* pool2d_backward(TensorHandle* self, PyObject* args, Pool2dBackwardFn fn, const char* op) {
+  PyObject* input_obj;
+  int kh, kw, sh, sw, ph, pw;
+  if (!PyArg_ParseTuple(args, "Oiiiiii", &input_obj, &kh, &kw, &sh, &sw, &ph, &pw)) {
+    return NULL;
+  }
+  TensorHandle* input = unwrap(input_obj, op);
+  if (input == NULL) {
+    return NULL;
+  }
+  Ref g = ref_of(self), x = ref_of(input);
+  return launch(self, op, {g, x},
+                [=](OpStatus*) { return fn(resolve(g), resolve(x), kh, kw, sh, sw, ph, pw); });
+}
+
+static PyObject* handle_max_pool2d(TensorHandle* self, PyObject* args) {
+  return pool2d(self, args, max_pool2d_tensor, "max_pool2d");
+}
+
+static PyObject* handle_avg_pool2d(TensorHandle* self, PyObject* args) {
+  return pool2d(self, args, avg_pool2d_tensor, "avg_pool2d");
+}
+
+static PyObject* handle_max_pool2d_backward(TensorHandle* self, PyObject* args) {
+  return pool2d_backward(self, args, max_pool2d_backward_tensor, "max_pool2d_backward");
+}
+
+static PyObject* handle_avg_pool2d_backward(TensorHandle* self, PyObject* args) {
+  return pool2d_backward(self, args, avg_pool2d_backward_tensor, "avg_pool2d_backward");
+}
+
+// Buffer protocol: zero-copy float32 export of the data (memoryview, numpy)
+
+static int handle_getbuffer(TensorHandle* self, Py_buffer* view, int flags) {
+  if (sync_handle(self, true) < 0) {
+    return -1;
+  }
+  Tensor* t = self->tensor;
+  Py_ssize_t* dims = (Py_ssize_t*)PyMem_Malloc(2 * t->ndim * sizeof(Py_ssize_t));
+  if (dims == NULL) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  for (int i = 0; i < t->ndim; i++) {
+    dims[i] = t->shape[i];
+    dims[t->ndim + i] = (Py_ssize_t)t->strides[i] * sizeof(float);
+  }
+
+  view->obj = (PyObject*)self;
+  Py_INCREF(self);
+  view->buf = t->data;
+  view->len = (Py_ssize_t)t->size * sizeof(float);
+  view->readonly = 0;
+  view->itemsize = sizeof(float);
+  view->format = (flags & PyBUF_FORMAT) ? (char*)"f" : NULL;
+  view->ndim = t->ndim;
+  view->shape = (flags & PyBUF_ND) ? dims : NULL;
+  view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? dims + t->ndim : NULL;
+  view->suboffsets = NULL;
+  view->internal = dims;
+  return 0;
+}
+
+static void handle_releasebuffer(TensorHandle*, Py_buffer* view) { PyMem_Free(view->internal); }
+
+static PyBufferProcs handle_as_buffer = {
+    (getbufferproc)handle_getbuffer,
+    (releasebufferproc)handle_releasebuffer,
+};
+
+static PyGetSetDef handle_getset[] = {
+    {"shape", (getter)handle_get_shape, NULL, "Dimensions as a list of ints", NULL},
+    {"ndim", (getter)handle_get_ndim, NULL, "Number of dimensions", NULL},
+    {"size", (getter)handle_get_size, NULL, "Number of elements", NULL},
+    {"address", (getter)handle_get_address, NULL, "Address of the underlying C Tensor", NULL},
+    {"base", (getter)handle_get_base, NULL, "Handle owning the data if this is a view, else None", NULL},
+    {NULL, NULL, NULL, NULL, NULL},
+};
+
+#define METHOD(name, flags) {#name, (PyCFunction)handle_##name, flags, NULL}
+
+static PyMethodDef handle_methods[] = {
+    {"from_address", (PyCFunction)handle_from_address, METH_O | METH_CLASS,
+     "Take ownership of a Tensor* returned by another backend entry point"},
+    {"empty", (PyCFunction)handle_empty, METH_O | METH_CLASS, "Uninitialized tensor of the given shape"},
+    METHOD(item, METH_O),
+    METHOD(tolist, METH_NOARGS),
+    METHOD(add, METH_O),
+    METHOD(sub, METH_O),
+    METHOD(mul, METH_O),
+    METHOD(div, METH_O),
+    METHOD(copy, METH_NOARGS),
+    METHOD(ones_like, METH_NOARGS),
+    METHOD(zeros_like, METH_NOARGS),
+    METHOD(T, METH_NOARGS),
+    METHOD(sigmoid, METH_NOARGS),
+    METHOD(log, METH_NOARGS),
+    METHOD(scalar_mul, METH_O),
+    METHOD(div_scalar, METH_O),
+    METHOD(pow_scalar, METH_O),
+    METHOD(scalar_pow, METH_O),
+    METHOD(reshape, METH_O),
+    METHOD(permute, METH_O),
+    METHOD(transpose, METH_VARARGS),
+    METHOD(sum, METH_VARARGS),
+    METHOD(view, METH_O),
+    METHOD(slice, METH_VARARGS),
+    METHOD(slice_backward, METH_VARARGS),
+    METHOD(index_select, METH_VARARGS),
+    METHOD(index_select_backward, METH_VARARGS),
+    METHOD(gather, METH_VARARGS),
+    METHOD(gather_backward, METH_VARARGS),
+    METHOD(scatter_add, METH_VARARGS),
+    METHOD(matmul, METH_VARARGS),
+    METHOD(matmul_accumulate, METH_VARARGS),
+    METHOD(uniform_, METH_VARARGS),
+    METHOD(normal_, METH_VARARGS),
+    METHOD(dropout, METH_VARARGS),
+    METHOD(conv2d, METH_VARARGS),
+    METHOD(conv2d_backward_input, METH_VARARGS),
+    METHOD(conv2d_backward_weight, METH_VARARGS),
+    METHOD(conv2d_backward_bias, METH_NOARGS),
+    METHOD(max_pool2d, METH_VARARGS),
+    METHOD(avg_pool2d, METH_VARARGS),
+    METHOD(max_pool2d_backward, METH_VARARGS),
+    METHOD(avg_pool2d_backward, METH_VARARGS),
+    {NULL, NULL, 0, NULL},
+};
+
+// Module-level generator state
+
+static PyObject* backend_manual_seed(PyObject*, PyObject* arg) {
+  unsigned long long seed = PyLong_AsUnsignedLongLongMask(arg);
+  if (PyErr_Occurred()) {
+    return NULL;
+  }
+  manual_seed(seed);
+  Py_RETURN_NONE;
+}
+
+static PyObject* backend_initial_seed(PyObject*, PyObject*) { return PyLong_FromUnsignedLongLong(initial_seed()); }
+
+static PyObject* backend_get_rng_state(PyObject*, PyObject*) {
+  unsigned long long seed, offset;
+  get_rng_state(&seed, &offset);
+  return Py_BuildValue("KK", seed, offset);
+}
+
+static PyObject* backend_set_rng_state(PyObject*, PyObject* args) {
+  unsigned long long seed, offset;
+  if (!PyArg_ParseTuple(args, "KK", &seed, &offset)) {
+    return NULL;
+  }
+  set_rng_state(seed, offset);
+  Py_RETURN_NONE;
+}
+
+static PyObject* backend_random_reserve(PyObject*, PyObject* arg) {
+  long count = PyLong_AsLong(arg);
+  if (count == -1 && PyErr_Occurred()) {
+    return NULL;
+  }
+  unsigned long long seed, offset;
+  random_reserve(count, &seed, &offset);
+  return Py_BuildValue("KK", seed, offset);
+}
+
+// Module-level stream control
+
+static PyObject* backend_set_async(PyObject*, PyObject* arg) {
+  int enabled = PyObject_IsTrue(arg);
+  if (enabled < 0) {
+    return NULL;
+  }
+  if (!enabled && async_enabled) {
+    // Queued ops finish first; from here on ops run, and handles are freed,
+    // on the calling thread
+    async_enabled = false;
+    if (stream_synchronize() < 0) {
+      return NULL;
+    }
+  }
+  async_enabled = enabled;
+  Py_RETURN_NONE;
+}
+
+static PyObject* backend_is_async(PyObject*, PyObject*) { return PyBool_FromLong(async_enabled); }
+
+static PyObject* backend_synchronize(PyObject*, PyObject*) {
+  if (stream_synchronize() < 0) {
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef backend_methods[] = {
+    {"manual_seed", backend_manual_seed, METH_O, "Seed the global generator and rewind its counter"},
+    {"initial_seed", backend_initial_seed, METH_NOARGS, "Seed of the global generator"},
+    {"get_rng_state", backend_get_rng_state, METH_NOARGS, "(seed, offset) of the global generator"},
+    {"set_rng_state", backend_set_rng_state, METH_VARARGS,
+     "Restore a (seed, offset) pair returned by get_rng_state"},
+    {"random_reserve", backend_random_reserve, METH_O,
+     "Claim the counter range for 'count' values, returning (seed, offset)"},
+    {"set_async", backend_set_async, METH_O, "Queue ops on the execution stream instead of running them inline"},
+    {"is_async", backend_is_async, METH_NOARGS, "Whether ops are queued on the execution stream"},
+    {"synchronize", backend_synchronize, METH_NOARGS,
+     "Wait for every queued op, raising the first error one of them hit"},
+    {NULL, NULL, 0, NULL},
+};
+
+static struct PyModuleDef backend_module = {
+    PyModuleDef_HEAD_INIT, "_backend", "Native binding for the tensor backend", -1, backend_methods, NULL, NULL, NULL,
+    NULL,
+};
+
+PyMODINIT_FUNC PyInit__backend(void) {
+  TensorHandleType.tp_name = "_backend.TensorHandle";
+  TensorHandleType.tp_doc = "Owning handle to a backend Tensor";
+  TensorHandleType.tp_basicsize = sizeof(TensorHandle);
+  TensorHandleType.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE;
+  TensorHandleType.tp_new = handle_new;
+  TensorHandleType.tp_dealloc = (destructor)handle_dealloc;
+  TensorHandleType.tp_methods = handle_methods;
+  TensorHandleType.tp_getset = handle_getset;
+  TensorHandleType.tp_as_buffer = &handle_as_buffer;
+  if (PyType_Ready(&TensorHandleType) < 0) {
+    return NULL;
+  }
+
+  PyObject* module = PyModule_Create(&backend_module);
+  if (module == NULL) {
+    return NULL;
+  }
+  Py_INCREF(&TensorHandleType);
+  if (PyModule_AddObject(module, "TensorHandle", (PyObject*)&TensorHandleType) < 0) {
+    Py_DECREF(&TensorHandleType);
+    Py_DECREF(module);
+    return NULL;
+  }
+  return module;
+}
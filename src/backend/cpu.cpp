@@ -1,4 +1,49 @@
 #include "tensor.h"
+#include "cpu.h"
+#include "memory.h"
+#include "autotune.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include <utility>
+
+// Element-wise kernels, first-touch initialization included, all split
+// [0, size) with the same static schedule, so each thread works on the
+// pages it placed on its own NUMA node
+
+// Edge of the cache tile used by the transposing copy
+#define TRANSPOSE_TILE 64
+
+// Inner dimensions (N and K) with a compile-time specialized GEMM kernel;
+// override with e.g. -DSMALL_GEMM_SIZES=1,3,10,64
+#ifndef SMALL_GEMM_SIZES
+#define SMALL_GEMM_SIZES 1, 2, 4, 8, 16, 32, 64
+#endif
+
+// Upper bound on the im2col scratch tile, in floats (~512KB)
+#define IM2COL_TILE_FLOATS 131072
+
+static int max_threads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+static int thread_id() {
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
 
 void add_tensor_cpu(const Tensor* tensor1, const Tensor* tensor2, Tensor* result) {
   if (tensor1->size != tensor2->size) {
@@ -6,9 +51,9 @@ void add_tensor_cpu(const Tensor* tensor1, const Tensor* tensor2, Tensor* result
     return;
   }
 
-  for (int i = 0; i < tensor1->size; i++) {
+  parallel_for(tensor1->size, [&](long i) {
     result->data[i] = tensor1->data[i] + tensor2->data[i];
-  }
+  });
 }
 
 void sub_tensor_cpu(const Tensor* tensor1, const Tensor* tensor2, Tensor* result) {
@@ -17,9 +62,9 @@ void sub_tensor_cpu(const Tensor* tensor1, const Tensor* tensor2, Tensor* result
     return;
   }
 
-  for (int i = 0; i < tensor1->size; i++) {
+  parallel_for(tensor1->size, [&](long i) {
     result->data[i] = tensor1->data[i] - tensor2->data[i];
-  }
+  });
 }
 
 void elementwise_mul_tensor_cpu(const Tensor* tensor1, const Tensor* tensor2, Tensor* result) {
@@ -28,9 +73,9 @@ void elementwise_mul_tensor_cpu(const Tensor* tensor1, const Tensor* tensor2, Te
     return;
   }
 
-  for (int i = 0; i < tensor1->size; i++) {
+  parallel_for(tensor1->size, [&](long i) {
     result->data[i] = tensor1->data[i] * tensor2->data[i];
-  }
+  });
 }
 
 void assign_tensor_cpu(const Tensor* tensor, Tensor* result) {
@@ -39,68 +84,328 @@ void assign_tensor_cpu(const Tensor* tensor, Tensor* result) {
     return;
   }
 
-  for (int i = 0; i < tensor->size; i++) {
+  parallel_for(tensor->size, [&](long i) {
     result->data[i] = tensor->data[i];
-  }
+  });
 }
 
 void assign_tensor_cpu(Tensor* tensor, float* result_data) {
-  for (int i = 0; i < tensor->size; i++) {
+  parallel_for(tensor->size, [&](long i) {
     result_data[i] = tensor->data[i];
-  }
+  });
+}
+
+void copy_data_cpu(const float* src, float* dst, long count) {
+  parallel_for(count, [&](long i) {
+    dst[i] = src[i];
+  });
 }
 
 void ones_like_tensor_cpu(Tensor* tensor, float* result_data) {
-  for (int i = 0; i < tensor->size; i++) {
+  parallel_for(tensor->size, [&](long i) {
     result_data[i] = 1.0;
-  }
+  });
 }
 
 void zeros_like_tensor_cpu(Tensor* tensor, float* result_data) {
-  for (int i = 0; i < tensor->size; i++) {
+  parallel_for(tensor->size, [&](long i) {
     result_data[i] = 0.0;
-  }
+  });
 }
 
-void transpose_1D_tensor_cpu(Tensor* tensor, float* result_data) {
-  for (int i = 0; i < tensor->shape[0]; i++) {
-    result_data[i] = tensor->data[i];
+// B[j * ldb + i] = A[i * lda + j] for an 8x8 block
+static inline void transpose_8x8(const float* A, long lda, float* B, long ldb) {
+#ifdef __AVX__
+  __m256 r0 = _mm256_loadu_ps(A);
+  __m256 r1 = _mm256_loadu_ps(A + lda);
+  __m256 r2 = _mm256_loadu_ps(A + 2 * lda);
+  __m256 r3 = _mm256_loadu_ps(A + 3 * lda);
+  __m256 r4 = _mm256_loadu_ps(A + 4 * lda);
+  __m256 r5 = _mm256_loadu_ps(A + 5 * lda);
+  __m256 r6 = _mm256_loadu_ps(A + 6 * lda);
+  __m256 r7 = _mm256_loadu_ps(A + 7 * lda);
+
+  __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+  __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+  __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+  __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+  __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+  __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+  __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+  __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+  __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+  _mm256_storeu_ps(B, _mm256_permute2f128_ps(u0, u4, 0x20));
+  _mm256_storeu_ps(B + ldb, _mm256_permute2f128_ps(u1, u5, 0x20));
+  _mm256_storeu_ps(B + 2 * ldb, _mm256_permute2f128_ps(u2, u6, 0x20));
+  _mm256_storeu_ps(B + 3 * ldb, _mm256_permute2f128_ps(u3, u7, 0x20));
+  _mm256_storeu_ps(B + 4 * ldb, _mm256_permute2f128_ps(u0, u4, 0x31));
+  _mm256_storeu_ps(B + 5 * ldb, _mm256_permute2f128_ps(u1, u5, 0x31));
+  _mm256_storeu_ps(B + 6 * ldb, _mm256_permute2f128_ps(u2, u6, 0x31));
+  _mm256_storeu_ps(B + 7 * ldb, _mm256_permute2f128_ps(u3, u7, 0x31));
+#else
+  for (int i = 0; i < 8; i++) {
+    for (int j = 0; j < 8; j++) {
+      B[j * ldb + i] = A[i * lda + j];
+    }
   }
+#endif
 }
 
-void transpose_2D_tensor_cpu(Tensor* tensor, float* result_data) {
-  int rows = tensor->shape[0];
-  int cols = tensor->shape[1];
-
-  for (int i = 0; i < rows; i++) {
+// B[j * ldb + i] = A[i * lda + j] for i < rows, j < cols
+static void transpose_block(const float* A, long lda, float* B, long ldb, int rows, int cols) {
+  int i = 0;
+  for (; i + 8 <= rows; i += 8) {
+    int j = 0;
+    for (; j + 8 <= cols; j += 8) {
+      transpose_8x8(A + i * lda + j, lda, B + j * ldb + i, ldb);
+    }
+    for (; j < cols; j++) {
+      for (int ii = i; ii < i + 8; ii++) {
+        B[j * ldb + ii] = A[ii * lda + j];
+      }
+    }
+  }
+  for (; i < rows; i++) {
     for (int j = 0; j < cols; j++) {
-      result_data[j * rows + i] = tensor->data[i * cols + j];
+      B[j * ldb + i] = A[i * lda + j];
     }
   }
 }
 
-void transpose_3D_tensor_cpu(Tensor* tensor, float* result_data) {
-  int batch = tensor->shape[0];
-  int rows = tensor->shape[1];
-  int cols = tensor->shape[2];
+void strided_copy_cpu(const float* src, const int* shape, const int* strides, int ndim, float* dst) {
+  // Gathers the strided view (shape, strides) of 'src' into a C-contiguous 'dst'
+  if (ndim > TENSOR_MAX_DIMS) {
+    fprintf(stderr, "Strided copy supports tensors up to %d dimensions (got %d)\n", TENSOR_MAX_DIMS, ndim);
+    return;
+  }
+  long dims[TENSOR_MAX_DIMS];
+  long src_strides[TENSOR_MAX_DIMS];
+  long dst_strides[TENSOR_MAX_DIMS];
+
+  // Drop unit dims and merge neighbours that are contiguous with each other
+  // in the source (the destination is contiguous everywhere)
+  int n = 0;
+  for (int d = 0; d < ndim; d++) {
+    if (shape[d] == 1) continue;
+    if (n > 0 && src_strides[n - 1] == (long)strides[d] * shape[d]) {
+      dims[n - 1] *= shape[d];
+      src_strides[n - 1] = strides[d];
+    } else {
+      dims[n] = shape[d];
+      src_strides[n] = strides[d];
+      n++;
+    }
+  }
+  if (n == 0) {
+    dst[0] = src[0];
+    return;
+  }
+
+  long total = 1;
+  for (int d = n - 1; d >= 0; d--) {
+    dst_strides[d] = total;
+    total *= dims[d];
+  }
+
+  int last = n - 1;
+  int unit = -1;
+  for (int d = 0; d < n; d++) {
+    if (src_strides[d] == 1) unit = d;
+  }
+
+  if (unit == last) {
+    // Rows are contiguous on both sides
+    if (n == 1) {
+      copy_data_cpu(src, dst, total);
+      return;
+    }
+    long row = dims[last];
+    long rows = total / row;
+
+    #pragma omp parallel for if (total > PARALLEL_GRAIN)
+    for (long r = 0; r < rows; r++) {
+      long offset = 0;
+      long index = r;
+      for (int d = last - 1; d >= 0; d--) {
+        offset += (index % dims[d]) * src_strides[d];
+        index /= dims[d];
+      }
+      memcpy(dst + r * row, src + offset, row * sizeof(float));
+    }
+  } else if (unit >= 0) {
+    // The source's unit-stride dim is not the destination's: a batch of 2D
+    // transposes between dims 'unit' and 'last', done in cache tiles
+    long rows = dims[last];
+    long cols = dims[unit];
+    long lda = src_strides[last];
+    long ldb = dst_strides[unit];
+    long tiles_r = (rows + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+    long tiles_c = (cols + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+    long outer = total / (rows * cols);
+
+    #pragma omp parallel for schedule(dynamic, 4) if (total > PARALLEL_GRAIN)
+    for (long job = 0; job < outer * tiles_r * tiles_c; job++) {
+      long tc = job % tiles_c;
+      long tr = (job / tiles_c) % tiles_r;
+      long index = job / (tiles_c * tiles_r);
 
-  for (int i = 0; i < batch; i++) {
-    for (int j = 0; j < rows; j++) {
-      for (int k = 0; k < cols; k++) {
-        result_data[k * rows * batch + j * batch + i] = tensor->data[i * rows * cols + j * cols + k];
+      long src_offset = 0;
+      long dst_offset = 0;
+      for (int d = last - 1; d >= 0; d--) {
+        if (d == unit) continue;
+        long i = index % dims[d];
+        index /= dims[d];
+        src_offset += i * src_strides[d];
+        dst_offset += i * dst_strides[d];
+      }
+
+      long r0 = tr * TRANSPOSE_TILE;
+      long c0 = tc * TRANSPOSE_TILE;
+      int tile_rows = rows - r0 < TRANSPOSE_TILE ? rows - r0 : TRANSPOSE_TILE;
+      int tile_cols = cols - c0 < TRANSPOSE_TILE ? cols - c0 : TRANSPOSE_TILE;
+      transpose_block(src + src_offset + r0 * lda + c0, lda, dst + dst_offset + c0 * ldb + r0, ldb,
+                      tile_rows, tile_cols);
+    }
+  } else {
+    // No unit-stride dim in the source (e.g. a strided slice): gather rows
+    long row = dims[last];
+    long stride = src_strides[last];
+    long rows = total / row;
+
+    #pragma omp parallel for if (total > PARALLEL_GRAIN)
+    for (long r = 0; r < rows; r++) {
+      long offset = 0;
+      long index = r;
+      for (int d = last - 1; d >= 0; d--) {
+        offset += (index % dims[d]) * src_strides[d];
+        index /= dims[d];
+      }
+      const float* s = src + offset;
+      float* out = dst + r * row;
+      for (long j = 0; j < row; j++) {
+        out[j] = s[j * stride];
       }
     }
   }
 }
 
+void strided_assign_cpu(const float* src, const int* shape, const int* strides, int ndim, float* dst) {
+  // Inverse of strided_copy_cpu: scatters a C-contiguous 'src' into the
+  // strided view (shape, strides) of 'dst'. The view must not overlap itself
+  long row = shape[ndim - 1];
+  long stride = strides[ndim - 1];
+  long total = 1;
+  for (int d = 0; d < ndim; d++) {
+    total *= shape[d];
+  }
+  long rows = row > 0 ? total / row : 0;
+
+  parallel_for(rows, [&](long r) {
+    long offset = 0;
+    long index = r;
+    for (int d = ndim - 2; d >= 0; d--) {
+      offset += (index % shape[d]) * strides[d];
+      index /= shape[d];
+    }
+    const float* in = src + r * row;
+    float* out = dst + offset;
+    if (stride == 1) {
+      memcpy(out, in, row * sizeof(float));
+    } else {
+      for (long j = 0; j < row; j++) {
+        out[j * stride] = in[j];
+      }
+    }
+  }, row > 0 ? PARALLEL_GRAIN / row : PARALLEL_GRAIN);
+}
+
+// Index kernels see their tensors as [outer, dim, inner]: 'dim' is the
+// indexed dimension, outer and inner the products of the dims before and after.
+// Rows of 'inner' floats are the unit of work
+
+// Width of the column blocks the accumulating kernels split 'inner' into
+#define INDEX_BLOCK 256
+
+void index_select_cpu(const float* src, long outer, long src_dim, long inner, const int* index, long count,
+                      float* dst) {
+  // dst[o, k, :] = src[o, index[k], :]
+  parallel_for(outer * count, [&](long r) {
+    long o = r / count;
+    long k = r % count;
+    memcpy(dst + r * inner, src + (o * src_dim + index[k]) * inner, inner * sizeof(float));
+  }, PARALLEL_GRAIN / inner + 1);
+}
+
+void index_add_cpu(const float* src, long outer, long count, long inner, const int* index, long dst_dim,
+                   float* dst) {
+  // dst[o, index[k], :] += src[o, k, :]. Repeated indices hit the same row,
+  // so threads split (o, column block) and each walks every k in order:
+  // no two threads write the same float and the sum order is fixed
+  long blocks = (inner + INDEX_BLOCK - 1) / INDEX_BLOCK;
+  parallel_for(outer * blocks, [&](long job) {
+    long o = job / blocks;
+    long j0 = (job % blocks) * INDEX_BLOCK;
+    long j1 = j0 + INDEX_BLOCK < inner ? j0 + INDEX_BLOCK : inner;
+    for (long k = 0; k < count; k++) {
+      const float* in = src + (o * count + k) * inner;
+      float* out = dst + (o * dst_dim + index[k]) * inner;
+      for (long j = j0; j < j1; j++) {
+        out[j] += in[j];
+      }
+    }
+  }, PARALLEL_GRAIN / (count * INDEX_BLOCK) + 1);
+}
+
+void gather_cpu(const float* src, long outer, long src_dim, long inner, const int* index, long count,
+                float* dst) {
+  // dst[o, k, j] = src[o, index[o, k, j], j]
+  parallel_for(outer * count, [&](long r) {
+    long o = r / count;
+    const int* idx = index + r * inner;
+    const float* in = src + o * src_dim * inner;
+    float* out = dst + r * inner;
+    for (long j = 0; j < inner; j++) {
+      out[j] = in[(long)idx[j] * inner + j];
+    }
+  }, PARALLEL_GRAIN / inner + 1);
+}
+
+void scatter_add_cpu(const float* src, long outer, long count, long inner, const int* index, long dst_dim,
+                     float* dst) {
+  // dst[o, index[o, k, j], j] += src[o, k, j], split like index_add_cpu
+  long blocks = (inner + INDEX_BLOCK - 1) / INDEX_BLOCK;
+  parallel_for(outer * blocks, [&](long job) {
+    long o = job / blocks;
+    long j0 = (job % blocks) * INDEX_BLOCK;
+    long j1 = j0 + INDEX_BLOCK < inner ? j0 + INDEX_BLOCK : inner;
+    float* out = dst + o * dst_dim * inner;
+    for (long k = 0; k < count; k++) {
+      const float* in = src + (o * count + k) * inner;
+      const int* idx = index + (o * count + k) * inner;
+      for (long j = j0; j < j1; j++) {
+        out[(long)idx[j] * inner + j] += in[j];
+      }
+    }
+  }, PARALLEL_GRAIN / (count * INDEX_BLOCK) + 1);
+}
+
 void scalar_pow_tensor_cpu(float base, Tensor* tensor, float* result_data) {
-  for (int i = 0; i < tensor->size; i++) {
+  parallel_for(tensor->size, [&](long i) {
     result_data[i] = powf(base, tensor->data[i]);
-  }
+  });
 }
 
 void sigmoid_tensor_cpu(Tensor* tensor, float* result_data) {
-  for (int i = 0; i < tensor->size; i++) {
+  parallel_for(tensor->size, [&](long i) {
     // avoid overflow
     if (tensor->data[i] >= 0) {
       float z = expf(-tensor->data[i]);
@@ -110,7 +415,7 @@ void sigmoid_tensor_cpu(Tensor* tensor, float* result_data) {
       float z = expf(tensor->data[i]);
       result_data[i] = z / (1 + z);
     }
-  }
+  });
 }
 
 void sum_tensor_cpu(Tensor* tensor, float* result_data, int size, int* result_shape, int axis) {
@@ -144,67 +449,722 @@ void sum_tensor_cpu(Tensor* tensor, float* result_data, int size, int* result_sh
 }
 
 void tensor_pow_scalar_cpu(Tensor* tensor, float exponent, float* result_data) {
-  for (int i = 0; i < tensor->size; i++) {
+  parallel_for(tensor->size, [&](long i) {
     result_data[i] = powf(tensor->data[i], exponent);
-  }
+  });
 }
 
 void log_tensor_cpu(Tensor* tensor, float* result_data) {
-  for (int i = 0; i < tensor->size; i++) {
+  parallel_for(tensor->size, [&](long i) {
     result_data[i] = logf(tensor->data[i]);
-  }
+  });
 }
 
 void scalar_mul_tensor_cpu(Tensor* tensor, float scalar, float* result_data) {
-  for (int i = 0; i < tensor->size; i++) {
+  parallel_for(tensor->size, [&](long i) {
     result_data[i] = scalar * tensor->data[i];
-  }
-}
-
-void matmul_tensor_cpu(Tensor* tensor1, Tensor* tensor2, float* result_data) {
-  for (int i = 0; i < tensor1->shape[0]; i++) {
-    for (int j = 0; j < tensor2->shape[1]; j++) {
-      float sum = 0.0;
-      for (int k = 0; k < tensor1->shape[1]; k++) {
-        sum += tensor1->data[i * tensor1->shape[1] + k] * tensor2->data[k * tensor2->shape[1] + j];
-      }
-      result_data[i * tensor2->shape[1] + j] = sum;
-    }
-  }
+  });
 }
 
 void scalar_div_tensor_cpu(float scalar, Tensor* tensor, float* result_data) {
-  for (int i = 0; i < tensor->size; i++) {
+  parallel_for(tensor->size, [&](long i) {
     result_data[i] = scalar / tensor->data[i];
-  }
+  });
 }
 
 void tensor_div_scalar_cpu(Tensor* tensor, float scalar, float* result_data) {
-  for (int i = 0; i < tensor->size; i++) {
+  parallel_for(tensor->size, [&](long i) {
     result_data[i] = tensor->data[i] / scalar;
-  }
+  });
 }
 
 void tensor_div_tensor_cpu(Tensor* tensor1, Tensor* tensor2, float* result_data) {
-  for (int i = 0; i < tensor1->size; i++) {
+  parallel_for(tensor1->size, [&](long i) {
     result_data[i] = tensor1->data[i] / tensor2->data[i];
-  }
+  });
 }
 
 void make_contiguous_tensor_cpu(Tensor* tensor, float* result_data, int* new_strides) {
-  for (int i = 0; i < tensor->size; i++) {
-    int index = 0;
-    int offset = i;
-    for (int j = 0; j < tensor->ndim; j++) {
-      index += (offset / new_strides[j]) * tensor->strides[j];
-      offset %= new_strides[j];
-    }
-    result_data[i] = tensor->data[index];
-  }
+  strided_copy_cpu(tensor->data, tensor->shape, tensor->strides, tensor->ndim, result_data);
 
   // Free old data and update tensor properties
-  free(tensor->data);
+  tensor_data_free(tensor->data);
   free(tensor->strides);
   tensor->data = result_data;
   tensor->strides = new_strides;
 }
+
+
+// Small products: N and K are template parameters, so the loops below have
+// constant trip counts and unroll completely, with no packing, allocation or
+// OpenMP region. Rows are independent, so M stays a runtime loop. The
+// additions into C come in the order gemm_blocked_cpu uses, k in groups of
+// four, and C is scaled by beta in its own pass as there, so that the scaling
+// is never contracted into an FMA with the products: both paths give the
+// same result.
+template <int N, int K, bool TransA, bool TransB>
+static void small_gemm_kernel(int M, float alpha, const float* A, int lda, const float* B, int ldb, float beta,
+                              float* C, int ldc) {
+  if (beta != 0.0f && beta != 1.0f) {
+    for (int i = 0; i < M; i++) {
+      float* c = C + (long)i * ldc;
+      for (int j = 0; j < N; j++) {
+        c[j] *= beta;
+      }
+    }
+  }
+
+  for (int i = 0; i < M; i++) {
+    float* c = C + (long)i * ldc;
+    float acc[N];
+    for (int j = 0; j < N; j++) {
+      acc[j] = beta == 0.0f ? 0.0f : c[j];
+    }
+
+    float a[K];
+    #pragma GCC unroll 64
+    for (int k = 0; k < K; k++) {
+      a[k] = alpha * (TransA ? A[(long)k * lda + i] : A[(long)i * lda + k]);
+    }
+    #pragma GCC unroll 16
+    for (int k = 0; k + 4 <= K; k += 4) {
+      for (int j = 0; j < N; j++) {
+        float b0 = TransB ? B[(long)j * ldb + k] : B[(long)k * ldb + j];
+        float b1 = TransB ? B[(long)j * ldb + k + 1] : B[(long)(k + 1) * ldb + j];
+        float b2 = TransB ? B[(long)j * ldb + k + 2] : B[(long)(k + 2) * ldb + j];
+        float b3 = TransB ? B[(long)j * ldb + k + 3] : B[(long)(k + 3) * ldb + j];
+        acc[j] += a[k] * b0 + a[k + 1] * b1 + a[k + 2] * b2 + a[k + 3] * b3;
+      }
+    }
+    #pragma GCC unroll 4
+    for (int k = K / 4 * 4; k < K; k++) {
+      for (int j = 0; j < N; j++) {
+        acc[j] += a[k] * (TransB ? B[(long)j * ldb + k] : B[(long)k * ldb + j]);
+      }
+    }
+
+    for (int j = 0; j < N; j++) {
+      c[j] = acc[j];
+    }
+  }
+}
+
+typedef void (*SmallGemmFn)(int, float, const float*, int, const float*, int, float, float*, int);
+
+static constexpr int small_gemm_sizes[] = {SMALL_GEMM_SIZES};
+static constexpr int small_gemm_count = sizeof(small_gemm_sizes) / sizeof(int);
+
+// Entry (n * count + k) * 4 + trans holds the kernel for N = sizes[n],
+// K = sizes[k]; bit 0 of trans is TransA, bit 1 TransB
+template <typename Sequence>
+struct SmallGemmTable;
+
+template <size_t... I>
+struct SmallGemmTable<std::index_sequence<I...>> {
+  static constexpr SmallGemmFn kernels[] = {
+      &small_gemm_kernel<small_gemm_sizes[I / 4 / small_gemm_count], small_gemm_sizes[I / 4 % small_gemm_count],
+                         (I & 1) != 0, (I & 2) != 0>...};
+};
+
+static const SmallGemmFn* small_gemm_table =
+    SmallGemmTable<std::make_index_sequence<small_gemm_count * small_gemm_count * 4>>::kernels;
+
+static int small_gemm_index(int size) {
+  for (int i = 0; i < small_gemm_count; i++) {
+    if (small_gemm_sizes[i] == size) return i;
+  }
+  return -1;
+}
+
+void gemm_cpu(bool trans_a, bool trans_b, int M, int N, int K, float alpha, const float* A, int lda,
+              const float* B, int ldb, float beta, float* C, int ldc) {
+  // C = alpha * op(A) @ op(B) + beta * C, all operands row-major. Products
+  // too small to parallelize take a specialized kernel when one exists for
+  // N and K; the rest use the blocking measured for their shape (see autotune.h)
+  if ((long)M * N * K <= PARALLEL_GRAIN && alpha != 0.0f) {
+    int n = small_gemm_index(N), k = small_gemm_index(K);
+    if (n >= 0 && k >= 0) {
+      int trans = (trans_a ? 1 : 0) | (trans_b ? 2 : 0);
+      small_gemm_table[(n * small_gemm_count + k) * 4 + trans](M, alpha, A, lda, B, ldb, beta, C, ldc);
+      return;
+    }
+  }
+
+  GemmConfig config = gemm_config(trans_a, trans_b, M, N, K);
+  gemm_blocked_cpu(&config, trans_a, trans_b, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void gemm_blocked_cpu(const GemmConfig* config, bool trans_a, bool trans_b, int M, int N, int K, float alpha,
+                      const float* A, int lda, const float* B, int ldb, float beta, float* C, int ldc) {
+  #pragma omp parallel for if ((long)M * N > PARALLEL_GRAIN)
+  for (int i = 0; i < M; i++) {
+    float* c = C + (long)i * ldc;
+    if (beta == 0.0f) {
+      for (int j = 0; j < N; j++) c[j] = 0.0f;
+    } else if (beta != 1.0f) {
+      for (int j = 0; j < N; j++) c[j] *= beta;
+    }
+  }
+  if (alpha == 0.0f || K == 0) {
+    return;
+  }
+
+  float* packed = (float*)malloc((long)config->kc * config->nc * sizeof(float));
+  if (packed == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return;
+  }
+
+  for (int jj = 0; jj < N; jj += config->nc) {
+    int nc = N - jj < config->nc ? N - jj : config->nc;
+    for (int kk = 0; kk < K; kk += config->kc) {
+      int kc = K - kk < config->kc ? K - kk : config->kc;
+
+      #pragma omp parallel num_threads(config->threads) if ((long)M * nc * kc > PARALLEL_GRAIN)
+      {
+        // Pack the kc x nc panel of op(B) so the inner loop is unit-stride
+        if (trans_b) {
+          #pragma omp for
+          for (int j = 0; j < nc; j++) {
+            const float* src = B + (long)(jj + j) * ldb + kk;
+            for (int k = 0; k < kc; k++) {
+              packed[k * nc + j] = src[k];
+            }
+          }
+        } else {
+          #pragma omp for
+          for (int k = 0; k < kc; k++) {
+            memcpy(packed + k * nc, B + (long)(kk + k) * ldb + jj, nc * sizeof(float));
+          }
+        }
+
+        #pragma omp for
+        for (int i = 0; i < M; i++) {
+          float* c = C + (long)i * ldc + jj;
+          int k = 0;
+          for (; k + 4 <= kc; k += 4) {
+            float a0, a1, a2, a3;
+            if (trans_a) {
+              a0 = A[(long)(kk + k) * lda + i];
+              a1 = A[(long)(kk + k + 1) * lda + i];
+              a2 = A[(long)(kk + k + 2) * lda + i];
+              a3 = A[(long)(kk + k + 3) * lda + i];
+            } else {
+              const float* a = A + (long)i * lda + kk + k;
+              a0 = a[0];
+              a1 = a[1];
+              a2 = a[2];
+              a3 = a[3];
+            }
+            a0 *= alpha;
+            a1 *= alpha;
+            a2 *= alpha;
+            a3 *= alpha;
+            const float* b0 = packed + k * nc;
+            const float* b1 = b0 + nc;
+            const float* b2 = b1 + nc;
+            const float* b3 = b2 + nc;
+            for (int j = 0; j < nc; j++) {
+              c[j] += a0 * b0[j] + a1 * b1[j] + a2 * b2[j] + a3 * b3[j];
+            }
+          }
+          for (; k < kc; k++) {
+            float a = alpha * (trans_a ? A[(long)(kk + k) * lda + i] : A[(long)i * lda + kk + k]);
+            const float* b = packed + k * nc;
+            for (int j = 0; j < nc; j++) {
+              c[j] += a * b[j];
+            }
+          }
+        }
+      }
+    }
+  }
+  free(packed);
+}
+
+void batched_gemm_cpu(bool trans_a, bool trans_b, int batch, int M, int N, int K, float alpha,
+                      const float* A, int lda, long stride_a, const float* B, int ldb, long stride_b,
+                      float beta, float* C, int ldc, long stride_c) {
+  // C[b] = alpha * op(A[b]) @ op(B[b]) + beta * C[b]. A zero stride
+  // broadcasts an operand over the batch; a zero stride_c sums every
+  // product into the single C.
+  if (stride_c == 0) {
+    for (int b = 0; b < batch; b++) {
+      gemm_cpu(trans_a, trans_b, M, N, K, alpha, A + b * stride_a, lda, B + b * stride_b, ldb,
+               b == 0 ? beta : 1.0f, C, ldc);
+    }
+    return;
+  }
+
+  // Small matrices cannot feed every thread from inside one GEMM, so give
+  // each thread whole matrices instead (the inner GEMM then runs serially)
+  bool batch_parallel = batch > 1 && (long)M * N * K < PARALLEL_GRAIN * 8L;
+
+  #pragma omp parallel for schedule(dynamic, 1) if (batch_parallel)
+  for (int b = 0; b < batch; b++) {
+    gemm_cpu(trans_a, trans_b, M, N, K, alpha, A + b * stride_a, lda, B + b * stride_b, ldb, beta,
+             C + b * stride_c, ldc);
+  }
+}
+
+void im2col_cpu(const float* input, int channels, int height, int width, int kernel_h, int kernel_w,
+                int stride_h, int stride_w, int pad_h, int pad_w, int dilation_h, int dilation_w,
+                int out_w, int col_start, int col_count, float* col) {
+  // Writes columns [col_start, col_start + col_count) of the
+  // (channels * kernel_h * kernel_w) x (out_h * out_w) patch matrix
+  int rows = channels * kernel_h * kernel_w;
+
+  #pragma omp parallel for if ((long)rows * col_count > PARALLEL_GRAIN)
+  for (int r = 0; r < rows; r++) {
+    int kj = r % kernel_w;
+    int ki = (r / kernel_w) % kernel_h;
+    int c = r / (kernel_w * kernel_h);
+    const float* plane = input + (long)c * height * width;
+    float* dst = col + (long)r * col_count;
+
+    int oh = col_start / out_w;
+    int ow = col_start % out_w;
+    for (int p = 0; p < col_count; p++) {
+      int ih = oh * stride_h - pad_h + ki * dilation_h;
+      int iw = ow * stride_w - pad_w + kj * dilation_w;
+      dst[p] = (ih >= 0 && ih < height && iw >= 0 && iw < width) ? plane[ih * width + iw] : 0.0f;
+      if (++ow == out_w) {
+        ow = 0;
+        oh++;
+      }
+    }
+  }
+}
+
+void col2im_cpu(const float* col, int channels, int height, int width, int kernel_h, int kernel_w,
+                int stride_h, int stride_w, int pad_h, int pad_w, int dilation_h, int dilation_w,
+                int out_w, int col_start, int col_count, float* input_grad) {
+  // Scatter-adds a column tile produced by im2col_cpu back into the image.
+  // Rows of one channel only touch that channel's plane, so channels run in parallel.
+  int kernel_size = kernel_h * kernel_w;
+
+  #pragma omp parallel for if ((long)channels * kernel_size * col_count > PARALLEL_GRAIN)
+  for (int c = 0; c < channels; c++) {
+    float* plane = input_grad + (long)c * height * width;
+    for (int k = 0; k < kernel_size; k++) {
+      int ki = k / kernel_w;
+      int kj = k % kernel_w;
+      const float* src = col + (long)(c * kernel_size + k) * col_count;
+
+      int oh = col_start / out_w;
+      int ow = col_start % out_w;
+      for (int p = 0; p < col_count; p++) {
+        int ih = oh * stride_h - pad_h + ki * dilation_h;
+        int iw = ow * stride_w - pad_w + kj * dilation_w;
+        if (ih >= 0 && ih < height && iw >= 0 && iw < width) {
+          plane[ih * width + iw] += src[p];
+        }
+        if (++ow == out_w) {
+          ow = 0;
+          oh++;
+        }
+      }
+    }
+  }
+}
+
+static int im2col_tile_cols(int rows, int cols) {
+  int tile = IM2COL_TILE_FLOATS / (rows > 0 ? rows : 1);
+  if (tile < 64) {
+    tile = 64;
+  }
+  return tile < cols ? tile : cols;
+}
+
+static bool use_depthwise_direct(const Conv2dShape* s) {
+  return s->groups == s->in_channels && s->out_channels == s->in_channels &&
+         s->kernel_h * s->kernel_w <= 25;
+}
+
+static void depthwise_conv2d_cpu(const float* input, const float* weight, const Conv2dShape* s,
+                                 float* output) {
+  int planes = s->batch * s->in_channels;
+
+  #pragma omp parallel for
+  for (int plane = 0; plane < planes; plane++) {
+    int c = plane % s->in_channels;
+    const float* in = input + (long)plane * s->in_h * s->in_w;
+    const float* w = weight + c * s->kernel_h * s->kernel_w;
+    float* out = output + (long)plane * s->out_h * s->out_w;
+
+    for (int oh = 0; oh < s->out_h; oh++) {
+      for (int ow = 0; ow < s->out_w; ow++) {
+        float sum = 0.0f;
+        for (int ki = 0; ki < s->kernel_h; ki++) {
+          int ih = oh * s->stride_h - s->pad_h + ki * s->dilation_h;
+          if (ih < 0 || ih >= s->in_h) continue;
+          for (int kj = 0; kj < s->kernel_w; kj++) {
+            int iw = ow * s->stride_w - s->pad_w + kj * s->dilation_w;
+            if (iw < 0 || iw >= s->in_w) continue;
+            sum += in[ih * s->in_w + iw] * w[ki * s->kernel_w + kj];
+          }
+        }
+        out[oh * s->out_w + ow] = sum;
+      }
+    }
+  }
+}
+
+void conv2d_cpu(const float* input, const float* weight, const float* bias, const Conv2dShape* s,
+                float* output) {
+  int out_plane = s->out_h * s->out_w;
+
+  if (use_depthwise_direct(s)) {
+    depthwise_conv2d_cpu(input, weight, s, output);
+  } else {
+    int in_per_group = s->in_channels / s->groups;
+    int out_per_group = s->out_channels / s->groups;
+    int rows = in_per_group * s->kernel_h * s->kernel_w;
+    int tile = im2col_tile_cols(rows, out_plane);
+    // With enough images, give each thread whole images; otherwise let
+    // im2col and the GEMM parallelize inside a single image.
+    bool batch_parallel = s->batch >= max_threads() && max_threads() > 1;
+
+    #pragma omp parallel if (batch_parallel)
+    {
+      float* col = (float*)malloc((long)rows * tile * sizeof(float));
+
+      #pragma omp for
+      for (int n = 0; n < s->batch; n++) {
+        if (col == NULL) continue;
+        for (int g = 0; g < s->groups; g++) {
+          const float* in = input + ((long)n * s->in_channels + g * in_per_group) * s->in_h * s->in_w;
+          const float* w = weight + (long)g * out_per_group * rows;
+          float* out = output + ((long)n * s->out_channels + g * out_per_group) * out_plane;
+
+          for (int t = 0; t < out_plane; t += tile) {
+            int count = out_plane - t < tile ? out_plane - t : tile;
+            im2col_cpu(in, in_per_group, s->in_h, s->in_w, s->kernel_h, s->kernel_w, s->stride_h,
+                       s->stride_w, s->pad_h, s->pad_w, s->dilation_h, s->dilation_w, s->out_w, t,
+                       count, col);
+            gemm_cpu(false, false, out_per_group, count, rows, 1.0f, w, rows, col, count, 0.0f,
+                     out + t, out_plane);
+          }
+        }
+      }
+      if (col == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+      }
+      free(col);
+    }
+  }
+
+  if (bias != NULL) {
+    int planes = s->batch * s->out_channels;
+    #pragma omp parallel for if ((long)planes * out_plane > PARALLEL_GRAIN)
+    for (int plane = 0; plane < planes; plane++) {
+      float b = bias[plane % s->out_channels];
+      float* out = output + (long)plane * out_plane;
+      for (int p = 0; p < out_plane; p++) {
+        out[p] += b;
+      }
+    }
+  }
+}
+
+void conv2d_backward_input_cpu(const float* grad_output, const float* weight, const Conv2dShape* s,
+                               float* grad_input) {
+  int out_plane = s->out_h * s->out_w;
+  long in_size = (long)s->batch * s->in_channels * s->in_h * s->in_w;
+  memset(grad_input, 0, in_size * sizeof(float));
+
+  if (use_depthwise_direct(s)) {
+    int planes = s->batch * s->in_channels;
+
+    #pragma omp parallel for
+    for (int plane = 0; plane < planes; plane++) {
+      int c = plane % s->in_channels;
+      const float* gout = grad_output + (long)plane * out_plane;
+      const float* w = weight + c * s->kernel_h * s->kernel_w;
+      float* gin = grad_input + (long)plane * s->in_h * s->in_w;
+
+      for (int oh = 0; oh < s->out_h; oh++) {
+        for (int ow = 0; ow < s->out_w; ow++) {
+          float g = gout[oh * s->out_w + ow];
+          for (int ki = 0; ki < s->kernel_h; ki++) {
+            int ih = oh * s->stride_h - s->pad_h + ki * s->dilation_h;
+            if (ih < 0 || ih >= s->in_h) continue;
+            for (int kj = 0; kj < s->kernel_w; kj++) {
+              int iw = ow * s->stride_w - s->pad_w + kj * s->dilation_w;
+              if (iw < 0 || iw >= s->in_w) continue;
+              gin[ih * s->in_w + iw] += g * w[ki * s->kernel_w + kj];
+            }
+          }
+        }
+      }
+    }
+    return;
+  }
+
+  int in_per_group = s->in_channels / s->groups;
+  int out_per_group = s->out_channels / s->groups;
+  int rows = in_per_group * s->kernel_h * s->kernel_w;
+  int tile = im2col_tile_cols(rows, out_plane);
+  bool batch_parallel = s->batch >= max_threads() && max_threads() > 1;
+
+  #pragma omp parallel if (batch_parallel)
+  {
+    float* col = (float*)malloc((long)rows * tile * sizeof(float));
+
+    #pragma omp for
+    for (int n = 0; n < s->batch; n++) {
+      if (col == NULL) continue;
+      for (int g = 0; g < s->groups; g++) {
+        const float* gout = grad_output + ((long)n * s->out_channels + g * out_per_group) * out_plane;
+        const float* w = weight + (long)g * out_per_group * rows;
+        float* gin = grad_input + ((long)n * s->in_channels + g * in_per_group) * s->in_h * s->in_w;
+
+        for (int t = 0; t < out_plane; t += tile) {
+          int count = out_plane - t < tile ? out_plane - t : tile;
+          // col = W^T @ grad_output tile
+          gemm_cpu(true, false, rows, count, out_per_group, 1.0f, w, rows, gout + t, out_plane, 0.0f,
+                   col, count);
+          col2im_cpu(col, in_per_group, s->in_h, s->in_w, s->kernel_h, s->kernel_w, s->stride_h,
+                     s->stride_w, s->pad_h, s->pad_w, s->dilation_h, s->dilation_w, s->out_w, t,
+                     count, gin);
+        }
+      }
+    }
+    if (col == NULL) {
+      fprintf(stderr, "Memory allocation failed\n");
+    }
+    free(col);
+  }
+}
+
+void conv2d_backward_weight_cpu(const float* grad_output, const float* input, const Conv2dShape* s,
+                                float* grad_weight) {
+  int out_plane = s->out_h * s->out_w;
+  int in_per_group = s->in_channels / s->groups;
+  int out_per_group = s->out_channels / s->groups;
+  int rows = in_per_group * s->kernel_h * s->kernel_w;
+  long weight_size = (long)s->out_channels * rows;
+  memset(grad_weight, 0, weight_size * sizeof(float));
+
+  if (use_depthwise_direct(s)) {
+    int kernel_size = s->kernel_h * s->kernel_w;
+
+    // Each channel owns its own filter, so channels never race
+    #pragma omp parallel for
+    for (int c = 0; c < s->in_channels; c++) {
+      float* gw = grad_weight + c * kernel_size;
+      for (int n = 0; n < s->batch; n++) {
+        long plane = (long)n * s->in_channels + c;
+        const float* in = input + plane * s->in_h * s->in_w;
+        const float* gout = grad_output + plane * out_plane;
+        for (int ki = 0; ki < s->kernel_h; ki++) {
+          for (int kj = 0; kj < s->kernel_w; kj++) {
+            float sum = 0.0f;
+            for (int oh = 0; oh < s->out_h; oh++) {
+              int ih = oh * s->stride_h - s->pad_h + ki * s->dilation_h;
+              if (ih < 0 || ih >= s->in_h) continue;
+              for (int ow = 0; ow < s->out_w; ow++) {
+                int iw = ow * s->stride_w - s->pad_w + kj * s->dilation_w;
+                if (iw < 0 || iw >= s->in_w) continue;
+                sum += in[ih * s->in_w + iw] * gout[oh * s->out_w + ow];
+              }
+            }
+            gw[ki * s->kernel_w + kj] += sum;
+          }
+        }
+      }
+    }
+    return;
+  }
+
+  int tile = im2col_tile_cols(rows, out_plane);
+  bool batch_parallel = s->batch >= max_threads() && max_threads() > 1;
+  int threads = batch_parallel ? max_threads() : 1;
+
+  // Images are split across threads, so each thread accumulates into a
+  // private copy of the weight gradient that is reduced at the end
+  float* partial = NULL;
+  if (threads > 1) {
+    partial = (float*)calloc((long)(threads - 1) * weight_size, sizeof(float));
+    if (partial == NULL) {
+      fprintf(stderr, "Memory allocation failed\n");
+      return;
+    }
+  }
+
+  #pragma omp parallel num_threads(threads) if (batch_parallel)
+  {
+    int tid = thread_id();
+    float* gw_local = tid == 0 ? grad_weight : partial + (long)(tid - 1) * weight_size;
+    float* col = (float*)malloc((long)rows * tile * sizeof(float));
+
+    #pragma omp for
+    for (int n = 0; n < s->batch; n++) {
+      if (col == NULL) continue;
+      for (int g = 0; g < s->groups; g++) {
+        const float* in = input + ((long)n * s->in_channels + g * in_per_group) * s->in_h * s->in_w;
+        const float* gout = grad_output + ((long)n * s->out_channels + g * out_per_group) * out_plane;
+        float* gw = gw_local + (long)g * out_per_group * rows;
+
+        for (int t = 0; t < out_plane; t += tile) {
+          int count = out_plane - t < tile ? out_plane - t : tile;
+          im2col_cpu(in, in_per_group, s->in_h, s->in_w, s->kernel_h, s->kernel_w, s->stride_h,
+                     s->stride_w, s->pad_h, s->pad_w, s->dilation_h, s->dilation_w, s->out_w, t,
+                     count, col);
+          // grad_W += grad_output tile @ col^T
+          gemm_cpu(false, true, out_per_group, rows, count, 1.0f, gout + t, out_plane, col, count,
+                   1.0f, gw, rows);
+        }
+      }
+    }
+    if (col == NULL) {
+      fprintf(stderr, "Memory allocation failed\n");
+    }
+    free(col);
+  }
+
+  if (partial != NULL) {
+    #pragma omp parallel for if (weight_size > PARALLEL_GRAIN)
+    for (long i = 0; i < weight_size; i++) {
+      for (int t = 0; t < threads - 1; t++) {
+        grad_weight[i] += partial[(long)t * weight_size + i];
+      }
+    }
+    free(partial);
+  }
+}
+
+void conv2d_backward_bias_cpu(const float* grad_output, const Conv2dShape* s, float* grad_bias) {
+  int out_plane = s->out_h * s->out_w;
+
+  #pragma omp parallel for if ((long)s->batch * s->out_channels * out_plane > PARALLEL_GRAIN)
+  for (int c = 0; c < s->out_channels; c++) {
+    float sum = 0.0f;
+    for (int n = 0; n < s->batch; n++) {
+      const float* gout = grad_output + ((long)n * s->out_channels + c) * out_plane;
+      for (int p = 0; p < out_plane; p++) {
+        sum += gout[p];
+      }
+    }
+    grad_bias[c] = sum;
+  }
+}
+
+void max_pool2d_cpu(const float* input, const Pool2dShape* s, float* output) {
+  int planes = s->batch * s->channels;
+
+  #pragma omp parallel for if ((long)planes * s->out_h * s->out_w > PARALLEL_GRAIN)
+  for (int plane = 0; plane < planes; plane++) {
+    const float* in = input + (long)plane * s->in_h * s->in_w;
+    float* out = output + (long)plane * s->out_h * s->out_w;
+
+    for (int oh = 0; oh < s->out_h; oh++) {
+      for (int ow = 0; ow < s->out_w; ow++) {
+        float best = -INFINITY;
+        for (int ki = 0; ki < s->kernel_h; ki++) {
+          int ih = oh * s->stride_h - s->pad_h + ki;
+          if (ih < 0 || ih >= s->in_h) continue;
+          for (int kj = 0; kj < s->kernel_w; kj++) {
+            int iw = ow * s->stride_w - s->pad_w + kj;
+            if (iw < 0 || iw >= s->in_w) continue;
+            float v = in[ih * s->in_w + iw];
+            if (v > best) best = v;
+          }
+        }
+        out[oh * s->out_w + ow] = best;
+      }
+    }
+  }
+}
+
+void max_pool2d_backward_cpu(const float* grad_output, const float* input, const Pool2dShape* s,
+                             float* grad_input) {
+  // The argmax is recomputed from the input instead of being stored in forward
+  int planes = s->batch * s->channels;
+  memset(grad_input, 0, (long)planes * s->in_h * s->in_w * sizeof(float));
+
+  #pragma omp parallel for if ((long)planes * s->out_h * s->out_w > PARALLEL_GRAIN)
+  for (int plane = 0; plane < planes; plane++) {
+    const float* in = input + (long)plane * s->in_h * s->in_w;
+    const float* gout = grad_output + (long)plane * s->out_h * s->out_w;
+    float* gin = grad_input + (long)plane * s->in_h * s->in_w;
+
+    for (int oh = 0; oh < s->out_h; oh++) {
+      for (int ow = 0; ow < s->out_w; ow++) {
+        float best = -INFINITY;
+        int best_index = -1;
+        for (int ki = 0; ki < s->kernel_h; ki++) {
+          int ih = oh * s->stride_h - s->pad_h + ki;
+          if (ih < 0 || ih >= s->in_h) continue;
+          for (int kj = 0; kj < s->kernel_w; kj++) {
+            int iw = ow * s->stride_w - s->pad_w + kj;
+            if (iw < 0 || iw >= s->in_w) continue;
+            float v = in[ih * s->in_w + iw];
+            if (v > best || best_index < 0) {
+              best = v;
+              best_index = ih * s->in_w + iw;
+            }
+          }
+        }
+        if (best_index >= 0) {
+          gin[best_index] += gout[oh * s->out_w + ow];
+        }
+      }
+    }
+  }
+}
+
+void avg_pool2d_cpu(const float* input, const Pool2dShape* s, float* output) {
+  // Padding counts towards the divisor, matching count_include_pad=True
+  int planes = s->batch * s->channels;
+  float scale = 1.0f / (s->kernel_h * s->kernel_w);
+
+  #pragma omp parallel for if ((long)planes * s->out_h * s->out_w > PARALLEL_GRAIN)
+  for (int plane = 0; plane < planes; plane++) {
+    const float* in = input + (long)plane * s->in_h * s->in_w;
+    float* out = output + (long)plane * s->out_h * s->out_w;
+
+    for (int oh = 0; oh < s->out_h; oh++) {
+      for (int ow = 0; ow < s->out_w; ow++) {
+        float sum = 0.0f;
+        for (int ki = 0; ki < s->kernel_h; ki++) {
+          int ih = oh * s->stride_h - s->pad_h + ki;
+          if (ih < 0 || ih >= s->in_h) continue;
+          for (int kj = 0; kj < s->kernel_w; kj++) {
+            int iw = ow * s->stride_w - s->pad_w + kj;
+            if (iw < 0 || iw >= s->in_w) continue;
+            sum += in[ih * s->in_w + iw];
+          }
+        }
+        out[oh * s->out_w + ow] = sum * scale;
+      }
+    }
+  }
+}
+
+void avg_pool2d_backward_cpu(const float* grad_output, const Pool2dShape* s, float* grad_input) {
+  int planes = s->batch * s->channels;
+  float scale = 1.0f / (s->kernel_h * s->kernel_w);
+  memset(grad_input, 0, (long)planes * s->in_h * s->in_w * sizeof(float));
+
+  #pragma omp parallel for if ((long)planes * s->out_h * s->out_w > PARALLEL_GRAIN)
+  for (int plane = 0; plane < planes; plane++) {
+    const float* gout = grad_output + (long)plane * s->out_h * s->out_w;
+    float* gin = grad_input + (long)plane * s->in_h * s->in_w;
+
+    for (int oh = 0; oh < s->out_h; oh++) {
+      for (int ow = 0; ow < s->out_w; ow++) {
+        float g = gout[oh * s->out_w + ow] * scale;
+        for (int ki = 0; ki < s->kernel_h; ki++) {
+          int ih = oh * s->stride_h - s->pad_h + ki;
+          if (ih < 0 || ih >= s->in_h) continue;
+          for (int kj = 0; kj < s->kernel_w; kj++) {
+            int iw = ow * s->stride_w - s->pad_w + kj;
+            if (iw < 0 || iw >= s->in_w) continue;
+            gin[ih * s->in_w + iw] += g;
+          }
+        }
+      }
+    }
+  }
+}
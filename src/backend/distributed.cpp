@@ -0,0 +1,301 @@
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <new>
+
+#include "distributed.h"
+
+#define SHM_MAGIC 0x4e4e4652
+#define SHM_ATTACH_TIMEOUT_US 30000000
+
+typedef struct {
+  std::atomic<int> magic;
+  std::atomic<int> attached;
+  std::atomic<int> ready;
+  std::atomic<int> arrived;
+  std::atomic<int> generation;
+  int world_size;
+  long capacity;
+} ShmHeader;
+
+static long header_bytes() {
+  // Keep the float buffers cache-line aligned
+  return (sizeof(ShmHeader) + 63) / 64 * 64;
+}
+
+static ShmHeader* header_of(ProcessGroup* group) {
+  return (ShmHeader*)group->shm;
+}
+
+static void wait_on(std::atomic<int>* value, int expected_not) {
+  int spins = 0;
+  while (value->load(std::memory_order_acquire) == expected_not) {
+    if (++spins > 1024) {
+      sched_yield();
+    }
+  }
+}
+
+static void barrier(ShmHeader* header, int world_size) {
+  int generation = header->generation.load(std::memory_order_acquire);
+  if (header->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == world_size) {
+    header->arrived.store(0, std::memory_order_relaxed);
+    header->generation.fetch_add(1, std::memory_order_release);
+  } else {
+    wait_on(&header->generation, generation);
+  }
+}
+
+// Whether 'name' still refers to the segment described by 'mapped'
+static bool same_segment(const char* name, const struct stat* mapped) {
+  int fd = shm_open(name, O_RDONLY, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  bool same = fstat(fd, &st) == 0 && st.st_dev == mapped->st_dev && st.st_ino == mapped->st_ino;
+  close(fd);
+  return same;
+}
+
+// Rank 0: create a fresh segment, wait until every rank has mapped it, then
+// mark it ready and drop the name
+static void* create_segment(const char* name, long bytes, int world_size, long capacity) {
+  shm_unlink(name);  // drop a segment left behind by a crashed run
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd >= 0 && ftruncate(fd, bytes) != 0) {
+    close(fd);
+    shm_unlink(name);
+    fd = -1;
+  }
+  if (fd < 0) {
+    fprintf(stderr, "Could not create shared memory segment %s\n", name);
+    return NULL;
+  }
+  void* shm = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED) {
+    fprintf(stderr, "Could not map shared memory segment %s\n", name);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  ShmHeader* header = new (shm) ShmHeader;
+  header->attached.store(1);
+  header->ready.store(0);
+  header->arrived.store(0);
+  header->generation.store(0);
+  header->world_size = world_size;
+  header->capacity = capacity;
+  header->magic.store(SHM_MAGIC, std::memory_order_release);
+
+  long waited = 0;
+  while (header->attached.load(std::memory_order_acquire) < world_size && waited < SHM_ATTACH_TIMEOUT_US) {
+    usleep(1000);
+    waited += 1000;
+  }
+  if (header->attached.load(std::memory_order_acquire) < world_size) {
+    fprintf(stderr, "Timed out waiting for %d ranks to join process group %s\n",
+            world_size - header->attached.load(), name);
+    shm_unlink(name);
+    munmap(shm, bytes);
+    return NULL;
+  }
+  // Everyone has mapped the segment, so the name is no longer needed. Ready
+  // is set first: joiners take a vanished name before it as a stale segment
+  header->ready.store(1, std::memory_order_release);
+  shm_unlink(name);
+  return shm;
+}
+
+// Other ranks: map the segment rank 0 created for this run. One left behind by
+// a crashed run can still be under the name; it is never marked ready, and is
+// given up on once rank 0 replaces (or removes) the name
+static void* join_segment(const char* name, long bytes, int rank, int world_size, long capacity) {
+  bool mismatched = false;
+  for (long waited = 0; waited < SHM_ATTACH_TIMEOUT_US; waited += 1000, usleep(1000)) {
+    int fd = shm_open(name, O_RDWR, 0600);
+    if (fd < 0) {
+      continue;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != bytes) {
+      close(fd);
+      continue;
+    }
+    void* shm = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+      continue;
+    }
+
+    ShmHeader* header = (ShmHeader*)shm;
+    bool joined = false;
+    for (; waited < SHM_ATTACH_TIMEOUT_US; waited += 1000, usleep(1000)) {
+      if (header->magic.load(std::memory_order_acquire) == SHM_MAGIC) {
+        mismatched = header->world_size != world_size || header->capacity != capacity;
+        if (mismatched) {
+          break;
+        }
+        if (!joined) {
+          header->attached.fetch_add(1, std::memory_order_acq_rel);
+          joined = true;
+        }
+        if (header->ready.load(std::memory_order_acquire)) {
+          return shm;
+        }
+      }
+      if (!same_segment(name, &st)) {
+        if (header->ready.load(std::memory_order_acquire)) {
+          return shm;
+        }
+        break;  // stale: rank 0 has replaced it
+      }
+    }
+    munmap(shm, bytes);
+  }
+  if (mismatched) {
+    fprintf(stderr, "Rank %d joined process group %s with a mismatched configuration\n", rank, name);
+  } else {
+    fprintf(stderr, "Timed out joining process group %s as rank %d\n", name, rank);
+  }
+  return NULL;
+}
+
+ProcessGroup* process_group_init(const char* name, int rank, int world_size, long capacity) {
+  if (name == NULL || name[0] != '/' || world_size <= 0 || rank < 0 || rank >= world_size ||
+      capacity <= 0) {
+    fprintf(stderr, "Invalid input to process_group_init\n");
+    return NULL;
+  }
+
+  long bytes = header_bytes() + (long)(world_size + 1) * capacity * sizeof(float);
+  void* shm = rank == 0 ? create_segment(name, bytes, world_size, capacity)
+                        : join_segment(name, bytes, rank, world_size, capacity);
+  if (shm == NULL) {
+    return NULL;
+  }
+
+  ProcessGroup* group = (ProcessGroup*)malloc(sizeof(ProcessGroup));
+  if (group == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    munmap(shm, bytes);
+    return NULL;
+  }
+  group->shm = shm;
+  group->shm_bytes = bytes;
+  group->slots = (float*)((char*)shm + header_bytes());
+  group->result = group->slots + (long)world_size * capacity;
+  group->capacity = capacity;
+  group->rank = rank;
+  group->world_size = world_size;
+  return group;
+}
+
+void process_group_destroy(ProcessGroup* group) {
+  if (group != NULL) {
+    munmap(group->shm, group->shm_bytes);
+    free(group);
+  }
+}
+
+void process_group_barrier(ProcessGroup* group) {
+  barrier(header_of(group), group->world_size);
+}
+
+// Copies elements [offset, offset + count) of the concatenation of 'tensors'
+// to or from 'buffer'
+static void copy_window(Tensor** tensors, int num_tensors, long offset, long count, float* buffer,
+                        bool to_buffer) {
+  long base = 0;
+  for (int t = 0; t < num_tensors && count > 0; t++) {
+    long size = tensors[t]->size;
+    if (offset < base + size) {
+      long start = offset - base;
+      long n = size - start < count ? size - start : count;
+      if (to_buffer) {
+        memcpy(buffer, tensors[t]->data + start, n * sizeof(float));
+      } else {
+        memcpy(tensors[t]->data + start, buffer, n * sizeof(float));
+      }
+      buffer += n;
+      offset += n;
+      count -= n;
+    }
+    base += size;
+  }
+}
+
+void process_group_allreduce(ProcessGroup* group, Tensor** tensors, int count, bool average) {
+  // Shared-memory variant of a ring all-reduce: the window is split into
+  // world_size chunks, each rank reduces the chunk it owns by reading the
+  // peers' slots in ring order starting from its neighbour (so ranks do not
+  // all hit the same slot at once), then every rank gathers all chunks.
+  ShmHeader* header = header_of(group);
+  int world_size = group->world_size;
+  int rank = group->rank;
+
+  long total = 0;
+  for (int t = 0; t < count; t++) {
+    total += tensors[t]->size;
+  }
+  float scale = average ? 1.0f / world_size : 1.0f;
+
+  for (long offset = 0; offset < total; offset += group->capacity) {
+    long window = total - offset < group->capacity ? total - offset : group->capacity;
+    copy_window(tensors, count, offset, window, group->slots + (long)rank * group->capacity, true);
+    barrier(header, world_size);
+
+    long chunk = (window + world_size - 1) / world_size;
+    long begin = (long)rank * chunk;
+    long end = begin + chunk < window ? begin + chunk : window;
+    if (begin < end) {
+      float* out = group->result + begin;
+      memcpy(out, group->slots + (long)rank * group->capacity + begin, (end - begin) * sizeof(float));
+      for (int step = 1; step < world_size; step++) {
+        const float* peer = group->slots + (long)((rank + step) % world_size) * group->capacity + begin;
+        for (long i = 0; i < end - begin; i++) {
+          out[i] += peer[i];
+        }
+      }
+      if (scale != 1.0f) {
+        for (long i = 0; i < end - begin; i++) {
+          out[i] *= scale;
+        }
+      }
+    }
+    barrier(header, world_size);
+
+    copy_window(tensors, count, offset, window, group->result, false);
+    // Nobody may overwrite the slots or result for the next window until all have read
+    barrier(header, world_size);
+  }
+}
+
+void process_group_broadcast(ProcessGroup* group, Tensor** tensors, int count, int root) {
+  ShmHeader* header = header_of(group);
+
+  long total = 0;
+  for (int t = 0; t < count; t++) {
+    total += tensors[t]->size;
+  }
+
+  for (long offset = 0; offset < total; offset += group->capacity) {
+    long window = total - offset < group->capacity ? total - offset : group->capacity;
+    if (group->rank == root) {
+      copy_window(tensors, count, offset, window, group->result, true);
+    }
+    barrier(header, group->world_size);
+    if (group->rank != root) {
+      copy_window(tensors, count, offset, window, group->result, false);
+    }
+    barrier(header, group->world_size);
+  }
+}
@@ -0,0 +1,26 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "tensor.h"
+
+// A group of processes on one host sharing a POSIX shared-memory segment.
+// Collectives are blocking and must be issued in the same order by every rank.
+typedef struct {
+    void* shm;
+    long shm_bytes;
+    float* slots;   // world_size staging buffers of 'capacity' floats each
+    float* result;  // one reduced buffer of 'capacity' floats
+    long capacity;
+    int rank;
+    int world_size;
+} ProcessGroup;
+
+extern "C" {
+    ProcessGroup* process_group_init(const char* name, int rank, int world_size, long capacity);
+    void process_group_destroy(ProcessGroup* group);
+    void process_group_barrier(ProcessGroup* group);
+    void process_group_allreduce(ProcessGroup* group, Tensor** tensors, int count, bool average);
+    void process_group_broadcast(ProcessGroup* group, Tensor** tensors, int count, int root);
+}
+
+#endif
@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "memory.h"
+
+// Linux mbind(2) modes, spelled out to avoid a libnuma dependency
+#define MPOL_PREFERRED 1
+#define MPOL_INTERLEAVE 3
+#define MPOL_LOCAL 4
+
+#define HUGE_PAGE_BYTES (2L << 20)
+#define HEADER_BYTES 64
+
+#define ALLOC_HEAP 0
+#define ALLOC_MMAP 1
+
+// Sits just before the data pointer handed out, keeping it 64-byte aligned
+typedef struct {
+  void* base;
+  long length;
+  int kind;
+} AllocHeader;
+
+static int placement_policy = PLACEMENT_FIRST_TOUCH;
+static int placement_node = -1;
+static long huge_page_threshold = HUGE_PAGE_BYTES;
+
+static unsigned long online_node_mask() {
+  // Parses /sys/devices/system/node/online, e.g. "0-1" or "0,2-3"
+  static unsigned long mask = 0;
+  if (mask != 0) {
+    return mask;
+  }
+  FILE* file = fopen("/sys/devices/system/node/online", "r");
+  if (file == NULL) {
+    return mask = 1;
+  }
+  int first, last;
+  char separator;
+  while (fscanf(file, "%d", &first) == 1) {
+    last = first;
+    if (fscanf(file, "%c", &separator) == 1 && separator == '-') {
+      if (fscanf(file, "%d", &last) != 1) break;
+      if (fscanf(file, "%c", &separator) != 1) separator = '\n';
+    }
+    for (int node = first; node <= last && node < 64; node++) {
+      mask |= 1UL << node;
+    }
+    if (separator != ',') break;
+  }
+  fclose(file);
+  return mask != 0 ? mask : (mask = 1);
+}
+
+int set_tensor_placement(int policy, int node) {
+  if (policy < PLACEMENT_FIRST_TOUCH || policy > PLACEMENT_LOCAL) {
+    fprintf(stderr, "Unknown tensor placement policy %d\n", policy);
+    return -1;
+  }
+  if (node >= 0 && (node >= 64 || !(online_node_mask() & (1UL << node)))) {
+    fprintf(stderr, "NUMA node %d is not online\n", node);
+    return -1;
+  }
+  placement_policy = policy;
+  placement_node = node;
+  return 0;
+}
+
+void set_huge_page_threshold(long bytes) {
+  huge_page_threshold = bytes;
+}
+
+static void apply_placement(void* addr, long length) {
+  unsigned long mask;
+  long mode;
+  switch (placement_policy) {
+    case PLACEMENT_INTERLEAVE:
+      mode = MPOL_INTERLEAVE;
+      mask = online_node_mask();
+      break;
+    case PLACEMENT_LOCAL:
+      mode = placement_node >= 0 ? MPOL_PREFERRED : MPOL_LOCAL;
+      mask = placement_node >= 0 ? 1UL << placement_node : 0;
+      break;
+    default:
+      return;
+  }
+  if (syscall(SYS_mbind, addr, length, mode, mode == MPOL_LOCAL ? NULL : &mask, 64, 0) != 0) {
+    // Not fatal: the kernel may lack NUMA support, pages then follow first touch
+    static bool warned = false;
+    if (!warned) {
+      fprintf(stderr, "mbind failed, tensor placement falls back to first touch\n");
+      warned = true;
+    }
+  }
+}
+
+float* tensor_data_alloc(long count) {
+  long bytes = count * (long)sizeof(float) + HEADER_BYTES;
+  char* data;
+  AllocHeader header;
+
+  if (huge_page_threshold > 0 && bytes >= huge_page_threshold) {
+    // Map with a huge page of slack so the buffer can start on a 2MB
+    // boundary, which transparent huge pages need
+    long length = bytes + HUGE_PAGE_BYTES;
+    void* base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+      return NULL;
+    }
+    uintptr_t aligned = ((uintptr_t)base + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1);
+    long usable = length - (long)(aligned - (uintptr_t)base);
+#ifdef MADV_HUGEPAGE
+    madvise((void*)aligned, usable, MADV_HUGEPAGE);
+#endif
+    apply_placement((void*)aligned, usable);
+
+    // The header shares the first page with the data; only that page is
+    // touched here, the rest is left to the kernels' first touch
+    data = (char*)aligned + HEADER_BYTES;
+    header.base = base;
+    header.length = length;
+    header.kind = ALLOC_MMAP;
+  } else {
+    void* base = NULL;
+    if (posix_memalign(&base, HEADER_BYTES, bytes) != 0) {
+      return NULL;
+    }
+    data = (char*)base + HEADER_BYTES;
+    header.base = base;
+    header.length = bytes;
+    header.kind = ALLOC_HEAP;
+  }
+
+  memcpy(data - HEADER_BYTES, &header, sizeof(AllocHeader));
+  return (float*)data;
+}
+
+void tensor_data_free(float* data) {
+  if (data == NULL) {
+    return;
+  }
+  AllocHeader header;
+  memcpy(&header, (char*)data - HEADER_BYTES, sizeof(AllocHeader));
+  if (header.kind == ALLOC_MMAP) {
+    munmap(header.base, header.length);
+  } else {
+    free(header.base);
+  }
+}
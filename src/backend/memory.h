@@ -0,0 +1,18 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+// Placement policies for tensor buffers at or above the huge-page threshold.
+// Smaller buffers always come from the heap and follow first touch.
+#define PLACEMENT_FIRST_TOUCH 0  // pages land on the node of the thread that first writes them
+#define PLACEMENT_INTERLEAVE 1   // pages are spread round-robin over all online nodes
+#define PLACEMENT_LOCAL 2        // pages prefer one node (or the allocating thread's node if node < 0)
+
+float* tensor_data_alloc(long count);
+void tensor_data_free(float* data);
+
+extern "C" {
+    int set_tensor_placement(int policy, int node);
+    void set_huge_page_threshold(long bytes);
+}
+
+#endif
@@ -0,0 +1,179 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+
+#include "cpu.h"
+#include "random.h"
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+#define DEFAULT_SEED 67280421310721ULL
+
+static std::atomic<unsigned long long> generator_seed(DEFAULT_SEED);
+static std::atomic<unsigned long long> generator_offset(0);
+
+void manual_seed(unsigned long long seed) {
+  generator_seed.store(seed);
+  generator_offset.store(0);
+}
+
+unsigned long long initial_seed() { return generator_seed.load(); }
+
+void get_rng_state(unsigned long long* seed, unsigned long long* offset) {
+  *seed = generator_seed.load();
+  *offset = generator_offset.load();
+}
+
+void set_rng_state(unsigned long long seed, unsigned long long offset) {
+  generator_seed.store(seed);
+  generator_offset.store(offset);
+}
+
+void random_reserve(long count, unsigned long long* seed, unsigned long long* offset) {
+  // One counter yields four values
+  *seed = generator_seed.load();
+  *offset = generator_offset.fetch_add((unsigned long long)(count + 3) / 4);
+}
+
+// Philox rounds for PHILOX_BATCH consecutive counters at once, laid out one
+// array per output word so the compiler can run the lanes in SIMD registers
+#define PHILOX_BATCH 64
+
+typedef struct {
+  uint32_t word[4][PHILOX_BATCH];
+} PhiloxBatch;
+
+static inline void philox4x32_batch(uint64_t first_counter, uint64_t seed, PhiloxBatch* out) {
+  uint32_t* c0 = out->word[0];
+  uint32_t* c1 = out->word[1];
+  uint32_t* c2 = out->word[2];
+  uint32_t* c3 = out->word[3];
+  for (int i = 0; i < PHILOX_BATCH; i++) {
+    uint64_t counter = first_counter + i;
+    c0[i] = (uint32_t)counter;
+    c1[i] = (uint32_t)(counter >> 32);
+    c2[i] = 0;
+    c3[i] = 0;
+  }
+
+  uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+  for (int round = 0; round < PHILOX_ROUNDS; round++) {
+    for (int i = 0; i < PHILOX_BATCH; i++) {
+      uint64_t p0 = (uint64_t)PHILOX_M0 * c0[i];
+      uint64_t p1 = (uint64_t)PHILOX_M1 * c2[i];
+      uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1[i] ^ k0;
+      uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3[i] ^ k1;
+      c1[i] = (uint32_t)p1;
+      c3[i] = (uint32_t)p0;
+      c0[i] = n0;
+      c2[i] = n2;
+    }
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+}
+
+// [0, 1) from the top 24 bits, exactly representable as a float
+static inline float uniform_closed_open(uint32_t bits) { return (bits >> 8) * (1.0f / 16777216.0f); }
+
+// (0, 1], safe to take the log of
+static inline float uniform_open_closed(uint32_t bits) { return ((bits >> 8) + 1) * (1.0f / 16777216.0f); }
+
+// Calls body(base, count, bits) for each run of up to 4 * PHILOX_BATCH
+// elements; element base + e draws word e % 4 of counter offset + (base + e) / 4.
+// Batches are split with a static schedule, so first touch matches the
+// element-wise kernels that later read the tensor
+template <typename Body>
+static void philox_for_each(long count, uint64_t seed, uint64_t offset, Body body) {
+  const long batch_elements = 4L * PHILOX_BATCH;
+  long batches = (count + batch_elements - 1) / batch_elements;
+  parallel_for(batches, [&](long batch) {
+    PhiloxBatch bits;
+    philox4x32_batch(offset + (uint64_t)batch * PHILOX_BATCH, seed, &bits);
+
+    long base = batch * batch_elements;
+    body(base, count - base < batch_elements ? count - base : batch_elements, bits);
+  }, PARALLEL_GRAIN / batch_elements);
+}
+
+void uniform_tensor(Tensor* tensor, float low, float high) {
+  unsigned long long seed, offset;
+  random_reserve(tensor->size, &seed, &offset);
+  uniform_fill_tensor(tensor, low, high, seed, offset);
+}
+
+void uniform_fill_tensor(Tensor* tensor, float low, float high, unsigned long long seed, unsigned long long offset) {
+  float* data = tensor->data;
+  float scale = high - low;
+  philox_for_each(tensor->size, seed, offset, [&](long base, long n, const PhiloxBatch& bits) {
+    float* out = data + base;
+    for (long i = 0; i < n / 4; i++) {
+      for (int j = 0; j < 4; j++) {
+        out[4 * i + j] = low + scale * uniform_closed_open(bits.word[j][i]);
+      }
+    }
+    for (long e = n / 4 * 4; e < n; e++) {
+      out[e] = low + scale * uniform_closed_open(bits.word[e % 4][e / 4]);
+    }
+  });
+}
+
+void normal_tensor(Tensor* tensor, float mean, float std) {
+  unsigned long long seed, offset;
+  random_reserve(tensor->size, &seed, &offset);
+  normal_fill_tensor(tensor, mean, std, seed, offset);
+}
+
+void normal_fill_tensor(Tensor* tensor, float mean, float std, unsigned long long seed, unsigned long long offset) {
+  // Box-Muller: words (0, 1) and (2, 3) of each counter give two normals each
+  float* data = tensor->data;
+  const float two_pi = 6.283185307179586f;
+  philox_for_each(tensor->size, seed, offset, [&](long base, long n, const PhiloxBatch& bits) {
+    for (long e = 0; e < n; e += 2) {
+      float radius = std * sqrtf(-2.0f * logf(uniform_open_closed(bits.word[e % 4][e / 4])));
+      float angle = two_pi * uniform_closed_open(bits.word[e % 4 + 1][e / 4]);
+      data[base + e] = mean + radius * cosf(angle);
+      if (e + 1 < n) {
+        data[base + e + 1] = mean + radius * sinf(angle);
+      }
+    }
+  });
+}
+
+Tensor* dropout_tensor(Tensor* input, float p, unsigned long long seed, unsigned long long offset) {
+  if (p < 0.0f || p > 1.0f) {
+    fprintf(stderr, "Dropout probability must be in [0, 1] (got %f)\n", p);
+    return NULL;
+  }
+
+  Tensor* result = allocate_tensor(input->shape, input->ndim);
+  if (result == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return NULL;
+  }
+
+  // The mask is regenerated from (seed, offset) rather than stored, so the
+  // backward pass applies the same call to the gradient
+  const float* x = input->data;
+  float* y = result->data;
+  float scale = p < 1.0f ? 1.0f / (1.0f - p) : 0.0f;
+  philox_for_each(input->size, seed, offset, [&](long base, long n, const PhiloxBatch& bits) {
+    const float* in = x + base;
+    float* out = y + base;
+    for (long i = 0; i < n / 4; i++) {
+      for (int j = 0; j < 4; j++) {
+        out[4 * i + j] = in[4 * i + j] * (uniform_closed_open(bits.word[j][i]) >= p ? scale : 0.0f);
+      }
+    }
+    for (long e = n / 4 * 4; e < n; e++) {
+      out[e] = in[e] * (uniform_closed_open(bits.word[e % 4][e / 4]) >= p ? scale : 0.0f);
+    }
+  });
+  return result;
+}
@@ -0,0 +1,25 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include "tensor.h"
+
+// Counter-based (Philox4x32-10) random numbers. Element i of a fill draws from
+// counter offset + i / 4, so the values depend only on (seed, offset, i): the
+// same seed gives the same tensors whatever the thread count or schedule.
+// Each fill claims a fresh counter range from the global generator; the
+// *_fill_tensor variants take a range claimed earlier with random_reserve.
+
+extern "C" {
+    void manual_seed(unsigned long long seed);
+    unsigned long long initial_seed();
+    void get_rng_state(unsigned long long* seed, unsigned long long* offset);
+    void set_rng_state(unsigned long long seed, unsigned long long offset);
+    void random_reserve(long count, unsigned long long* seed, unsigned long long* offset);
+    void uniform_tensor(Tensor* tensor, float low, float high);
+    void normal_tensor(Tensor* tensor, float mean, float std);
+    void uniform_fill_tensor(Tensor* tensor, float low, float high, unsigned long long seed, unsigned long long offset);
+    void normal_fill_tensor(Tensor* tensor, float mean, float std, unsigned long long seed, unsigned long long offset);
+    Tensor* dropout_tensor(Tensor* input, float p, unsigned long long seed, unsigned long long offset);
+}
+
+#endif
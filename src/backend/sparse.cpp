@@ -0,0 +1,488 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sparse.h"
+
+static SparseTensor* allocate_sparse_tensor(int rows, int cols, int nnz) {
+  SparseTensor* tensor = (SparseTensor*)malloc(sizeof(SparseTensor));
+  if (tensor == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return NULL;
+  }
+
+  tensor->rows = rows;
+  tensor->cols = cols;
+  tensor->nnz = nnz;
+  tensor->row_ptr = (int*)calloc(rows + 1, sizeof(int));
+  // Allocate at least one element so an empty matrix still has valid pointers
+  tensor->col_indices = (int*)malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+  tensor->values = (float*)malloc((nnz > 0 ? nnz : 1) * sizeof(float));
+  if (tensor->row_ptr == NULL || tensor->col_indices == NULL || tensor->values == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    free_sparse_tensor(tensor);
+    return NULL;
+  }
+  return tensor;
+}
+
+void free_sparse_tensor(SparseTensor* tensor) {
+  if (tensor != NULL) {
+    free(tensor->values);
+    free(tensor->col_indices);
+    free(tensor->row_ptr);
+    free(tensor);
+  }
+}
+
+typedef struct {
+  int col;
+  float value;
+} SparseEntry;
+
+static int compare_sparse_entry(const void* a, const void* b) {
+  return ((const SparseEntry*)a)->col - ((const SparseEntry*)b)->col;
+}
+
+SparseTensor* create_sparse_tensor_coo(const int* row_indices, const int* col_indices, const float* values,
+                                       int nnz, int rows, int cols) {
+  if (rows <= 0 || cols <= 0 || nnz < 0 || (nnz > 0 && (row_indices == NULL || col_indices == NULL ||
+                                                         values == NULL))) {
+    fprintf(stderr, "Invalid input to create_sparse_tensor_coo\n");
+    return NULL;
+  }
+  for (int i = 0; i < nnz; i++) {
+    if (row_indices[i] < 0 || row_indices[i] >= rows || col_indices[i] < 0 || col_indices[i] >= cols) {
+      fprintf(stderr, "Sparse index (%d, %d) out of bounds for shape %dx%d\n", row_indices[i],
+              col_indices[i], rows, cols);
+      return NULL;
+    }
+  }
+
+  // Bucket entries by row (counting sort), then sort each row by column
+  int* row_ptr = (int*)calloc(rows + 1, sizeof(int));
+  int* fill = (int*)malloc(rows * sizeof(int));
+  SparseEntry* entries = (SparseEntry*)malloc((nnz > 0 ? nnz : 1) * sizeof(SparseEntry));
+  if (row_ptr == NULL || fill == NULL || entries == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    free(row_ptr);
+    free(fill);
+    free(entries);
+    return NULL;
+  }
+
+  for (int i = 0; i < nnz; i++) {
+    row_ptr[row_indices[i] + 1]++;
+  }
+  for (int r = 0; r < rows; r++) {
+    row_ptr[r + 1] += row_ptr[r];
+    fill[r] = row_ptr[r];
+  }
+  for (int i = 0; i < nnz; i++) {
+    SparseEntry* entry = &entries[fill[row_indices[i]]++];
+    entry->col = col_indices[i];
+    entry->value = values[i];
+  }
+
+  // Duplicate coordinates are summed, so the merged row can only shrink
+  int* merged = fill;
+  #pragma omp parallel for schedule(dynamic, 64)
+  for (int r = 0; r < rows; r++) {
+    SparseEntry* row = entries + row_ptr[r];
+    int count = row_ptr[r + 1] - row_ptr[r];
+    qsort(row, count, sizeof(SparseEntry), compare_sparse_entry);
+
+    int out = 0;
+    for (int i = 0; i < count; i++) {
+      if (out > 0 && row[out - 1].col == row[i].col) {
+        row[out - 1].value += row[i].value;
+      } else {
+        row[out++] = row[i];
+      }
+    }
+    merged[r] = out;
+  }
+
+  int total = 0;
+  for (int r = 0; r < rows; r++) {
+    total += merged[r];
+  }
+
+  SparseTensor* tensor = allocate_sparse_tensor(rows, cols, total);
+  if (tensor != NULL) {
+    for (int r = 0; r < rows; r++) {
+      tensor->row_ptr[r + 1] = tensor->row_ptr[r] + merged[r];
+    }
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int r = 0; r < rows; r++) {
+      const SparseEntry* row = entries + row_ptr[r];
+      int dst = tensor->row_ptr[r];
+      for (int i = 0; i < merged[r]; i++) {
+        tensor->col_indices[dst + i] = row[i].col;
+        tensor->values[dst + i] = row[i].value;
+      }
+    }
+  }
+
+  free(row_ptr);
+  free(fill);
+  free(entries);
+  return tensor;
+}
+
+SparseTensor* sparse_from_dense_tensor(Tensor* tensor) {
+  if (tensor->ndim != 2) {
+    fprintf(stderr, "Only 2D tensors can be converted to sparse (got %dD)\n", tensor->ndim);
+    return NULL;
+  }
+
+  int rows = tensor->shape[0];
+  int cols = tensor->shape[1];
+  int* counts = (int*)malloc(rows * sizeof(int));
+  if (counts == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return NULL;
+  }
+
+  #pragma omp parallel for
+  for (int r = 0; r < rows; r++) {
+    const float* row = tensor->data + (long)r * cols;
+    int count = 0;
+    for (int c = 0; c < cols; c++) {
+      count += row[c] != 0.0f;
+    }
+    counts[r] = count;
+  }
+
+  int nnz = 0;
+  for (int r = 0; r < rows; r++) {
+    nnz += counts[r];
+  }
+
+  SparseTensor* result = allocate_sparse_tensor(rows, cols, nnz);
+  if (result == NULL) {
+    free(counts);
+    return NULL;
+  }
+  for (int r = 0; r < rows; r++) {
+    result->row_ptr[r + 1] = result->row_ptr[r] + counts[r];
+  }
+  free(counts);
+
+  #pragma omp parallel for
+  for (int r = 0; r < rows; r++) {
+    const float* row = tensor->data + (long)r * cols;
+    int dst = result->row_ptr[r];
+    for (int c = 0; c < cols; c++) {
+      if (row[c] != 0.0f) {
+        result->col_indices[dst] = c;
+        result->values[dst++] = row[c];
+      }
+    }
+  }
+  return result;
+}
+
+Tensor* sparse_to_dense_tensor(SparseTensor* tensor) {
+  int shape[2] = {tensor->rows, tensor->cols};
+  Tensor* result = allocate_tensor(shape, 2);
+  if (result == NULL) {
+    return NULL;
+  }
+
+  #pragma omp parallel for
+  for (int r = 0; r < tensor->rows; r++) {
+    float* row = result->data + (long)r * tensor->cols;
+    memset(row, 0, tensor->cols * sizeof(float));
+    for (int i = tensor->row_ptr[r]; i < tensor->row_ptr[r + 1]; i++) {
+      row[tensor->col_indices[i]] = tensor->values[i];
+    }
+  }
+  return result;
+}
+
+SparseTensor* add_sparse_tensor(SparseTensor* tensor1, SparseTensor* tensor2) {
+  if (tensor1->rows != tensor2->rows || tensor1->cols != tensor2->cols) {
+    fprintf(stderr, "Sparse tensors must have the same shape (%dx%d and %dx%d) for addition\n",
+            tensor1->rows, tensor1->cols, tensor2->rows, tensor2->cols);
+    return NULL;
+  }
+
+  int rows = tensor1->rows;
+  int* counts = (int*)malloc(rows * sizeof(int));
+  if (counts == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return NULL;
+  }
+
+  // First pass sizes each merged row, second pass fills it
+  #pragma omp parallel for
+  for (int r = 0; r < rows; r++) {
+    int i = tensor1->row_ptr[r], i_end = tensor1->row_ptr[r + 1];
+    int j = tensor2->row_ptr[r], j_end = tensor2->row_ptr[r + 1];
+    int count = 0;
+    while (i < i_end || j < j_end) {
+      if (j == j_end || (i < i_end && tensor1->col_indices[i] < tensor2->col_indices[j])) {
+        i++;
+      } else if (i == i_end || tensor2->col_indices[j] < tensor1->col_indices[i]) {
+        j++;
+      } else {
+        i++;
+        j++;
+      }
+      count++;
+    }
+    counts[r] = count;
+  }
+
+  int nnz = 0;
+  for (int r = 0; r < rows; r++) {
+    nnz += counts[r];
+  }
+
+  SparseTensor* result = allocate_sparse_tensor(rows, tensor1->cols, nnz);
+  if (result == NULL) {
+    free(counts);
+    return NULL;
+  }
+  for (int r = 0; r < rows; r++) {
+    result->row_ptr[r + 1] = result->row_ptr[r] + counts[r];
+  }
+  free(counts);
+
+  #pragma omp parallel for
+  for (int r = 0; r < rows; r++) {
+    int i = tensor1->row_ptr[r], i_end = tensor1->row_ptr[r + 1];
+    int j = tensor2->row_ptr[r], j_end = tensor2->row_ptr[r + 1];
+    int dst = result->row_ptr[r];
+    while (i < i_end || j < j_end) {
+      if (j == j_end || (i < i_end && tensor1->col_indices[i] < tensor2->col_indices[j])) {
+        result->col_indices[dst] = tensor1->col_indices[i];
+        result->values[dst] = tensor1->values[i++];
+      } else if (i == i_end || tensor2->col_indices[j] < tensor1->col_indices[i]) {
+        result->col_indices[dst] = tensor2->col_indices[j];
+        result->values[dst] = tensor2->values[j++];
+      } else {
+        result->col_indices[dst] = tensor1->col_indices[i];
+        result->values[dst] = tensor1->values[i++] + tensor2->values[j++];
+      }
+      dst++;
+    }
+  }
+  return result;
+}
+
+void sparse_axpy_tensor(SparseTensor* sparse, float alpha, Tensor* dense) {
+  // dense += alpha * sparse, touching only the stored entries
+  if (dense->ndim != 2 || dense->shape[0] != sparse->rows || dense->shape[1] != sparse->cols) {
+    fprintf(stderr, "Sparse update shape %dx%d does not match the dense tensor\n", sparse->rows,
+            sparse->cols);
+    return;
+  }
+
+  #pragma omp parallel for if (sparse->nnz > 32768)
+  for (int r = 0; r < sparse->rows; r++) {
+    float* row = dense->data + (long)r * sparse->cols;
+    for (int i = sparse->row_ptr[r]; i < sparse->row_ptr[r + 1]; i++) {
+      row[sparse->col_indices[i]] += alpha * sparse->values[i];
+    }
+  }
+}
+
+Tensor* spmm_tensor(SparseTensor* sparse, Tensor* dense) {
+  // [rows x cols] @ [cols x n] = [rows x n]
+  if (dense->ndim != 2 || dense->shape[0] != sparse->cols) {
+    fprintf(stderr, "Incompatible shapes for sparse matrix multiplication %dx%d and %dx%d\n",
+            sparse->rows, sparse->cols, dense->shape[0], dense->ndim > 1 ? dense->shape[1] : 1);
+    return NULL;
+  }
+
+  int n = dense->shape[1];
+  int shape[2] = {sparse->rows, n};
+  Tensor* result = allocate_tensor(shape, 2);
+  if (result == NULL) {
+    return NULL;
+  }
+
+  #pragma omp parallel for schedule(dynamic, 16)
+  for (int r = 0; r < sparse->rows; r++) {
+    float* out = result->data + (long)r * n;
+    memset(out, 0, n * sizeof(float));
+    for (int i = sparse->row_ptr[r]; i < sparse->row_ptr[r + 1]; i++) {
+      float v = sparse->values[i];
+      const float* b = dense->data + (long)sparse->col_indices[i] * n;
+      for (int j = 0; j < n; j++) {
+        out[j] += v * b[j];
+      }
+    }
+  }
+  return result;
+}
+
+static SparseTensor* transpose_sparse(const SparseTensor* tensor) {
+  SparseTensor* result = allocate_sparse_tensor(tensor->cols, tensor->rows, tensor->nnz);
+  if (result == NULL) {
+    return NULL;
+  }
+  int* fill = (int*)malloc(tensor->cols * sizeof(int));
+  if (fill == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    free_sparse_tensor(result);
+    return NULL;
+  }
+
+  for (int i = 0; i < tensor->nnz; i++) {
+    result->row_ptr[tensor->col_indices[i] + 1]++;
+  }
+  for (int c = 0; c < tensor->cols; c++) {
+    result->row_ptr[c + 1] += result->row_ptr[c];
+    fill[c] = result->row_ptr[c];
+  }
+  // Walking rows in order keeps the transposed column indices sorted
+  for (int r = 0; r < tensor->rows; r++) {
+    for (int i = tensor->row_ptr[r]; i < tensor->row_ptr[r + 1]; i++) {
+      int dst = fill[tensor->col_indices[i]]++;
+      result->col_indices[dst] = r;
+      result->values[dst] = tensor->values[i];
+    }
+  }
+  free(fill);
+  return result;
+}
+
+SparseTensor* spmm_transpose_tensor(SparseTensor* sparse, Tensor* dense) {
+  // sparse^T @ dense: [cols x rows] @ [rows x n]. Only columns of 'sparse'
+  // that hold entries produce non-zero rows, so the result is row-sparse
+  // (the embedding-gradient pattern).
+  if (dense->ndim != 2 || dense->shape[0] != sparse->rows) {
+    fprintf(stderr, "Incompatible shapes for transposed sparse matrix multiplication %dx%d and %dx%d\n",
+            sparse->cols, sparse->rows, dense->shape[0], dense->ndim > 1 ? dense->shape[1] : 1);
+    return NULL;
+  }
+
+  SparseTensor* transposed = transpose_sparse(sparse);
+  if (transposed == NULL) {
+    return NULL;
+  }
+
+  int n = dense->shape[1];
+  int touched = 0;
+  for (int r = 0; r < transposed->rows; r++) {
+    touched += transposed->row_ptr[r + 1] > transposed->row_ptr[r];
+  }
+
+  SparseTensor* result = allocate_sparse_tensor(transposed->rows, n, touched * n);
+  if (result == NULL) {
+    free_sparse_tensor(transposed);
+    return NULL;
+  }
+  for (int r = 0; r < transposed->rows; r++) {
+    int width = transposed->row_ptr[r + 1] > transposed->row_ptr[r] ? n : 0;
+    result->row_ptr[r + 1] = result->row_ptr[r] + width;
+  }
+
+  #pragma omp parallel for schedule(dynamic, 16)
+  for (int r = 0; r < transposed->rows; r++) {
+    if (result->row_ptr[r + 1] == result->row_ptr[r]) continue;
+    float* out = result->values + result->row_ptr[r];
+    int* cols = result->col_indices + result->row_ptr[r];
+    for (int j = 0; j < n; j++) {
+      out[j] = 0.0f;
+      cols[j] = j;
+    }
+    for (int i = transposed->row_ptr[r]; i < transposed->row_ptr[r + 1]; i++) {
+      float v = transposed->values[i];
+      const float* b = dense->data + (long)transposed->col_indices[i] * n;
+      for (int j = 0; j < n; j++) {
+        out[j] += v * b[j];
+      }
+    }
+  }
+
+  free_sparse_tensor(transposed);
+  return result;
+}
+
+Tensor* dense_spmm_tensor(Tensor* dense, SparseTensor* sparse) {
+  // [m x rows] @ [rows x cols] = [m x cols]
+  if (dense->ndim != 2 || dense->shape[1] != sparse->rows) {
+    fprintf(stderr, "Incompatible shapes for sparse matrix multiplication %dx%d and %dx%d\n",
+            dense->shape[0], dense->ndim > 1 ? dense->shape[1] : 1, sparse->rows, sparse->cols);
+    return NULL;
+  }
+
+  int m = dense->shape[0];
+  int k = dense->shape[1];
+  int shape[2] = {m, sparse->cols};
+  Tensor* result = allocate_tensor(shape, 2);
+  if (result == NULL) {
+    return NULL;
+  }
+
+  #pragma omp parallel for schedule(dynamic, 4)
+  for (int i = 0; i < m; i++) {
+    const float* a = dense->data + (long)i * k;
+    float* out = result->data + (long)i * sparse->cols;
+    memset(out, 0, sparse->cols * sizeof(float));
+    for (int r = 0; r < k; r++) {
+      float a_ir = a[r];
+      if (a_ir == 0.0f) continue;
+      for (int p = sparse->row_ptr[r]; p < sparse->row_ptr[r + 1]; p++) {
+        out[sparse->col_indices[p]] += a_ir * sparse->values[p];
+      }
+    }
+  }
+  return result;
+}
+
+SparseTensor* dense_spmm_transpose_tensor(Tensor* dense, SparseTensor* sparse) {
+  // dense @ sparse^T: [m x cols] @ [cols x rows]. Only rows of 'sparse' that
+  // hold entries produce non-zero columns, so every output row shares the
+  // same column pattern (the weight gradient of Linear on sparse features).
+  if (dense->ndim != 2 || dense->shape[1] != sparse->cols) {
+    fprintf(stderr, "Incompatible shapes for transposed sparse matrix multiplication %dx%d and %dx%d\n",
+            dense->shape[0], dense->ndim > 1 ? dense->shape[1] : 1, sparse->cols, sparse->rows);
+    return NULL;
+  }
+
+  int m = dense->shape[0];
+  int n = dense->shape[1];
+  int touched = 0;
+  for (int r = 0; r < sparse->rows; r++) {
+    touched += sparse->row_ptr[r + 1] > sparse->row_ptr[r];
+  }
+
+  SparseTensor* result = allocate_sparse_tensor(m, sparse->rows, m * touched);
+  if (result == NULL) {
+    return NULL;
+  }
+  int* pattern = result->col_indices;
+  for (int r = 0, t = 0; r < sparse->rows; r++) {
+    if (sparse->row_ptr[r + 1] > sparse->row_ptr[r]) {
+      pattern[t++] = r;
+    }
+  }
+  for (int i = 0; i <= m; i++) {
+    result->row_ptr[i] = i * touched;
+  }
+
+  #pragma omp parallel for schedule(dynamic, 4)
+  for (int i = 0; i < m; i++) {
+    const float* a = dense->data + (long)i * n;
+    float* out = result->values + (long)i * touched;
+    if (i > 0) {
+      memcpy(result->col_indices + (long)i * touched, pattern, touched * sizeof(int));
+    }
+    for (int t = 0; t < touched; t++) {
+      int r = pattern[t];
+      float sum = 0.0f;
+      for (int p = sparse->row_ptr[r]; p < sparse->row_ptr[r + 1]; p++) {
+        sum += a[sparse->col_indices[p]] * sparse->values[p];
+      }
+      out[t] = sum;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,30 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "tensor.h"
+
+// 2D sparse matrix in CSR form. Column indices are sorted and unique within a row.
+typedef struct {
+    float* values;
+    int* col_indices;
+    int* row_ptr;
+    int rows;
+    int cols;
+    int nnz;
+} SparseTensor;
+
+extern "C" {
+    SparseTensor* create_sparse_tensor_coo(const int* row_indices, const int* col_indices, const float* values,
+                                           int nnz, int rows, int cols);
+    void free_sparse_tensor(SparseTensor* tensor);
+    SparseTensor* sparse_from_dense_tensor(Tensor* tensor);
+    Tensor* sparse_to_dense_tensor(SparseTensor* tensor);
+    SparseTensor* add_sparse_tensor(SparseTensor* tensor1, SparseTensor* tensor2);
+    void sparse_axpy_tensor(SparseTensor* sparse, float alpha, Tensor* dense);
+    Tensor* spmm_tensor(SparseTensor* sparse, Tensor* dense);
+    SparseTensor* spmm_transpose_tensor(SparseTensor* sparse, Tensor* dense);
+    Tensor* dense_spmm_tensor(Tensor* dense, SparseTensor* sparse);
+    SparseTensor* dense_spmm_transpose_tensor(Tensor* dense, SparseTensor* sparse);
+}
+
+#endif
@@ -4,11 +4,12 @@
 #include <string.h>
 
 #include "cpu.h"
+#include "memory.h"
 #include "tensor.h"
 
-Tensor* create_tensor(const float* data, const int* shape, int ndim) {
-  if (data == NULL || shape == NULL || ndim <= 0) {
-    fprintf(stderr, "Invalid input to create_tensor\n");
+Tensor* allocate_tensor(const int* shape, int ndim) {
+  if (shape == NULL || ndim <= 0) {
+    fprintf(stderr, "Invalid input to allocate_tensor\n");
     return NULL;
   }
 
@@ -45,7 +46,9 @@ Tensor* create_tensor(const float* data, const int* shape, int ndim) {
     stride *= shape[i];
   }
 
-  tensor->data = (float*)malloc(tensor->size * sizeof(float));
+  // Pages are not touched here: the kernel that first writes the buffer
+  // places them next to the threads that will use them
+  tensor->data = tensor_data_alloc(tensor->size);
   if (tensor->data == NULL) {
     fprintf(stderr, "Memory allocation failed\n");
     free(tensor->strides);
@@ -53,16 +56,69 @@ Tensor* create_tensor(const float* data, const int* shape, int ndim) {
     free(tensor);
     return NULL;
   }
-  memcpy(tensor->data, data, tensor->size * sizeof(float));
 
   tensor->device = NULL;
 
   return tensor;
 }
 
+Tensor* create_tensor(const float* data, const int* shape, int ndim) {
+  if (data == NULL || shape == NULL || ndim <= 0) {
+    fprintf(stderr, "Invalid input to create_tensor\n");
+    return NULL;
+  }
+
+  Tensor* tensor = allocate_tensor(shape, ndim);
+  if (tensor == NULL) {
+    return NULL;
+  }
+  copy_data_cpu(data, tensor->data, tensor->size);
+
+  return tensor;
+}
+
 void free_tensor(Tensor* tensor) {
   if (tensor != NULL) {
-    free(tensor->data);
+    tensor_data_free(tensor->data);
+    free(tensor->strides);
+    free(tensor->shape);
+    free(tensor);
+  }
+}
+
+// A view shares its data with another tensor: only the metadata is its own.
+// The owner of the data must outlive it
+static Tensor* alias_tensor(Tensor* base, long offset, const int* shape, int ndim) {
+  Tensor* tensor = (Tensor*)malloc(sizeof(Tensor));
+  if (tensor == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return NULL;
+  }
+  tensor->shape = (int*)malloc(ndim * sizeof(int));
+  tensor->strides = (int*)malloc(ndim * sizeof(int));
+  if (tensor->shape == NULL || tensor->strides == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    free(tensor->shape);
+    free(tensor->strides);
+    free(tensor);
+    return NULL;
+  }
+  memcpy(tensor->shape, shape, ndim * sizeof(int));
+
+  tensor->ndim = ndim;
+  tensor->size = 1;
+  for (int i = ndim - 1; i >= 0; i--) {
+    tensor->strides[i] = tensor->size;
+    tensor->size *= shape[i];
+  }
+  tensor->data = base->data + offset;
+  tensor->device = NULL;
+
+  return tensor;
+}
+
+void free_tensor_view(Tensor* tensor) {
+  if (tensor != NULL) {
     free(tensor->strides);
     free(tensor->shape);
     free(tensor);
@@ -81,188 +137,81 @@ float get_element(const Tensor* tensor, const int* indices) {
   return tensor->data[index];
 }
 
-Tensor* add_tensor(const Tensor* tensor1, const Tensor* tensor2) {
-  if (tensor1->ndim != tensor2->ndim) {
-    fprintf(stderr,
-            "Tensors must have the same number of dimensions (%d and %d) for "
-            "addition\n",
-            tensor1->ndim, tensor2->ndim);
-    return NULL;
-  }
-
-  int ndim = tensor1->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
+// Result tensors are allocated with their final shape and written by the
+// kernel directly; nothing is staged through a temporary buffer
+static Tensor* allocate_like(const Tensor* tensor) {
+  Tensor* result = allocate_tensor(tensor->shape, tensor->ndim);
+  if (result == NULL) {
     fprintf(stderr, "Memory allocation failed\n");
-    return NULL;
   }
+  return result;
+}
 
-  for (int i = 0; i < ndim; i++) {
+static bool check_same_shape(const Tensor* tensor1, const Tensor* tensor2, const char* op) {
+  if (tensor1->ndim != tensor2->ndim) {
+    fprintf(stderr, "Tensors must have the same number of dimensions (%d and %d) for %s\n", tensor1->ndim,
+            tensor2->ndim, op);
+    return false;
+  }
+  for (int i = 0; i < tensor1->ndim; i++) {
     if (tensor1->shape[i] != tensor2->shape[i]) {
-      fprintf(stderr,
-              "Tensors must have the same shape (%d and %d) at index %d for "
-              "addition\n",
-              tensor1->shape[i], tensor2->shape[i], i);
-      free(shape);
-      return NULL;
+      fprintf(stderr, "Tensors must have the same shape (%d and %d) at index %d for %s\n", tensor1->shape[i],
+              tensor2->shape[i], i, op);
+      return false;
     }
-    shape[i] = tensor1->shape[i];
   }
+  return true;
+}
 
-  float* result_data = (float*)malloc(tensor1->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    free(shape);
+Tensor* add_tensor(const Tensor* tensor1, const Tensor* tensor2) {
+  if (!check_same_shape(tensor1, tensor2, "addition")) {
     return NULL;
   }
-
-  Tensor* result = create_tensor(result_data, shape, ndim);
+  Tensor* result = allocate_like(tensor1);
   if (result == NULL) {
-    free(shape);
-    free(result_data);
     return NULL;
   }
-
   add_tensor_cpu(tensor1, tensor2, result);
   return result;
 }
 
 Tensor* sub_tensor(const Tensor* tensor1, const Tensor* tensor2) {
-  if (tensor1->ndim != tensor2->ndim) {
-    fprintf(stderr,
-            "Tensors must have the same number of dimensions (%d and %d) for "
-            "subtraction\n",
-            tensor1->ndim, tensor2->ndim);
+  if (!check_same_shape(tensor1, tensor2, "subtraction")) {
     return NULL;
   }
-
-  int ndim = tensor1->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    return NULL;
-  }
-
-  for (int i = 0; i < ndim; i++) {
-    if (tensor1->shape[i] != tensor2->shape[i]) {
-      fprintf(stderr,
-              "Tensors must have the same shape (%d and %d) at index %d for "
-              "subtraction\n",
-              tensor1->shape[i], tensor2->shape[i], i);
-      free(shape);
-      return NULL;
-    }
-    shape[i] = tensor1->shape[i];
-  }
-
-  float* result_data = (float*)malloc(tensor1->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    free(shape);
-    return NULL;
-  }
-
-  Tensor* result = create_tensor(result_data, shape, ndim);
+  Tensor* result = allocate_like(tensor1);
   if (result == NULL) {
-    free(shape);
-    free(result_data);
     return NULL;
   }
-
   sub_tensor_cpu(tensor1, tensor2, result);
   return result;
 }
 
 Tensor* elementwise_mul_tensor(const Tensor* tensor1, const Tensor* tensor2) {
-  if (tensor1->ndim != tensor2->ndim) {
-    fprintf(stderr,
-            "Tensors must have the same number of dimensions (%d and %d) for "
-            "element-wise multiplication\n",
-            tensor1->ndim, tensor2->ndim);
-    return NULL;
-  }
-
-  int ndim = tensor1->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
+  if (!check_same_shape(tensor1, tensor2, "element-wise multiplication")) {
     return NULL;
   }
-
-  for (int i = 0; i < ndim; i++) {
-    if (tensor1->shape[i] != tensor2->shape[i]) {
-      fprintf(stderr,
-              "Tensors must have the same shape (%d and %d) at index %d for "
-              "element-wise multiplication\n",
-              tensor1->shape[i], tensor2->shape[i], i);
-      free(shape);
-      return NULL;
-    }
-    shape[i] = tensor1->shape[i];
-  }
-
-  float* result_data = (float*)malloc(tensor1->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    free(shape);
-    return NULL;
-  }
-
-  Tensor* result = create_tensor(result_data, shape, ndim);
+  Tensor* result = allocate_like(tensor1);
   if (result == NULL) {
-    free(shape);
-    free(result_data);
     return NULL;
   }
-
   elementwise_mul_tensor_cpu(tensor1, tensor2, result);
   return result;
 }
 
 Tensor* assign_tensor(const Tensor* tensor) {
-  int ndim = tensor->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    return NULL;
-  }
-
-  for (int i = 0; i < ndim; i++) {
-    shape[i] = tensor->shape[i];
-  }
-
-  float* result_data = (float*)malloc(tensor->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    free(shape);
-    return NULL;
-  }
-
-  Tensor* result = create_tensor(result_data, shape, ndim);
+  Tensor* result = allocate_like(tensor);
   if (result == NULL) {
-    free(shape);
-    free(result_data);
     return NULL;
   }
-
   assign_tensor_cpu(tensor, result);
   return result;
 }
 
 Tensor* reshape_tensor(Tensor* tensor, int* new_shape, int new_ndim) {
-  int* shape = (int*)malloc(new_ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    return NULL;
-  }
-
-  for (int i = 0; i < new_ndim; i++) {
-    shape[i] = new_shape[i];
-  }
-
   int new_size = 1;
   for (int i = 0; i < new_ndim; i++) {
-    new_size *= shape[i];
+    new_size *= new_shape[i];
   }
 
   if (new_size != tensor->size) {
@@ -270,21 +219,12 @@ Tensor* reshape_tensor(Tensor* tensor, int* new_shape, int new_ndim) {
             "Cannot reshape tensor. Total number of elements in new shape (%d) "
             "does not match the current size of the tensor (%d).\n",
             new_size, tensor->size);
-    free(shape);
     return NULL;
   }
 
-  float* result_data = (float*)malloc(tensor->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    free(shape);
-    return NULL;
-  }
-
-  Tensor* reshaped_tensor = create_tensor(result_data, shape, new_ndim);
+  Tensor* reshaped_tensor = allocate_tensor(new_shape, new_ndim);
   if (reshaped_tensor == NULL) {
-    free(shape);
-    free(result_data);
+    fprintf(stderr, "Memory allocation failed\n");
     return NULL;
   }
   assign_tensor_cpu(tensor, reshaped_tensor);
@@ -293,200 +233,459 @@ Tensor* reshape_tensor(Tensor* tensor, int* new_shape, int new_ndim) {
 }
 
 Tensor* ones_like_tensor(Tensor* tensor) {
-  int ndim = tensor->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
+  Tensor* result = allocate_tensor(tensor->shape, tensor->ndim);
+  if (result == NULL) {
     fprintf(stderr, "Memory allocation failed\n");
     exit(1);
   }
+  ones_like_tensor_cpu(tensor, result->data);
+  return result;
+}
 
-  for (int i = 0; i < ndim; i++) {
-    shape[i] = tensor->shape[i];
-  }
-
-  float* result_data = (float*)malloc(tensor->size * sizeof(float));
-  if (result_data == NULL) {
+Tensor* zeros_like_tensor(Tensor* tensor) {
+  Tensor* result = allocate_tensor(tensor->shape, tensor->ndim);
+  if (result == NULL) {
     fprintf(stderr, "Memory allocation failed\n");
     exit(1);
   }
-  ones_like_tensor_cpu(tensor, result_data);
-  return create_tensor(result_data, shape, ndim);
+  zeros_like_tensor_cpu(tensor, result->data);
+  return result;
 }
 
-Tensor* zeros_like_tensor(Tensor* tensor) {
+Tensor* transpose_tensor(Tensor* tensor) {
+  int dims[TENSOR_MAX_DIMS];
+  for (int i = 0; i < tensor->ndim && i < TENSOR_MAX_DIMS; i++) {
+    dims[i] = tensor->ndim - 1 - i;
+  }
+  return permute_tensor(tensor, dims);
+}
+
+Tensor* permute_tensor(Tensor* tensor, const int* dims) {
   int ndim = tensor->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+  if (ndim > TENSOR_MAX_DIMS) {
+    fprintf(stderr, "Permute supports tensors up to %d dimensions (got %d)\n", TENSOR_MAX_DIMS, ndim);
+    return NULL;
   }
 
+  int shape[TENSOR_MAX_DIMS];
+  int strides[TENSOR_MAX_DIMS];
+  bool seen[TENSOR_MAX_DIMS] = {false};
   for (int i = 0; i < ndim; i++) {
-    shape[i] = tensor->shape[i];
+    if (dims[i] < 0 || dims[i] >= ndim || seen[dims[i]]) {
+      fprintf(stderr, "Invalid permutation: dimension %d is out of range or repeated\n", dims[i]);
+      return NULL;
+    }
+    seen[dims[i]] = true;
+    shape[i] = tensor->shape[dims[i]];
+    strides[i] = tensor->strides[dims[i]];
   }
 
-  float* result_data = (float*)malloc(tensor->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+  Tensor* result = allocate_tensor(shape, ndim);
+  if (result == NULL) {
+    return NULL;
   }
-  zeros_like_tensor_cpu(tensor, result_data);
-  return create_tensor(result_data, shape, ndim);
+  strided_copy_cpu(tensor->data, shape, strides, ndim, result->data);
+  return result;
 }
 
-Tensor* transpose_tensor(Tensor* tensor) {
-  int ndim = tensor->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(-1);
+Tensor* view_tensor(Tensor* tensor, const int* shape, int ndim) {
+  long size = 1;
+  for (int i = 0; i < ndim; i++) {
+    size *= shape[i];
   }
+  if (ndim <= 0 || size != tensor->size) {
+    fprintf(stderr, "Cannot view a tensor of %d elements with a shape of %ld elements\n", tensor->size, size);
+    return NULL;
+  }
+  return alias_tensor(tensor, 0, shape, ndim);
+}
 
+// Element offset and strides of the slice (start, step, shape) of a tensor
+// with the given strides; false if it falls outside 'dims'
+static bool make_slice(const int* dims, const int* dim_strides, int ndim, const int* start, const int* step,
+                       const int* shape, long* offset, int* strides) {
+  *offset = 0;
   for (int i = 0; i < ndim; i++) {
-    shape[i] = tensor->shape[ndim - 1 - i];
+    if (step[i] <= 0 || shape[i] < 0) {
+      fprintf(stderr, "Slice step must be positive and its length non-negative (dimension %d)\n", i);
+      return false;
+    }
+    if (shape[i] > 0 && (start[i] < 0 || start[i] + (long)(shape[i] - 1) * step[i] >= dims[i])) {
+      fprintf(stderr, "Slice of dimension %d is out of bounds for size %d\n", i, dims[i]);
+      return false;
+    }
+    if (shape[i] > 0) {
+      *offset += (long)start[i] * dim_strides[i];
+    }
+    strides[i] = dim_strides[i] * step[i];
+  }
+  return true;
+}
+
+// 'shape' is the extent of the slice in each dimension of the tensor; the
+// result takes 'out_shape' (same element count), which may drop unit dims
+Tensor* slice_tensor(Tensor* tensor, const int* start, const int* step, const int* shape, const int* out_shape,
+                     int out_ndim, bool* is_view) {
+  int ndim = tensor->ndim;
+  if (ndim > TENSOR_MAX_DIMS) {
+    fprintf(stderr, "Slicing supports tensors up to %d dimensions (got %d)\n", TENSOR_MAX_DIMS, ndim);
+    return NULL;
+  }
+  long offset;
+  int strides[TENSOR_MAX_DIMS];
+  if (!make_slice(tensor->shape, tensor->strides, ndim, start, step, shape, &offset, strides)) {
+    return NULL;
   }
 
-  int size = tensor->size;
+  // Tensors are C-contiguous, so a slice can share the data only if it is a
+  // contiguous window: every dim of the slice longer than one must have the
+  // stride a contiguous tensor of the slice's shape would have
+  long size = 1;
+  bool contiguous = true;
+  for (int i = ndim - 1; i >= 0; i--) {
+    if (shape[i] > 1 && strides[i] != size) {
+      contiguous = false;
+    }
+    size *= shape[i];
+  }
 
-  float* result_data = (float*)malloc(size * sizeof(float));
-  if (result_data == NULL) {
+  long out_size = 1;
+  for (int i = 0; i < out_ndim; i++) {
+    out_size *= out_shape[i];
+  }
+  if (out_ndim <= 0 || out_size != size) {
+    fprintf(stderr, "Slice of %ld elements cannot take a shape of %ld elements\n", size, out_size);
+    return NULL;
+  }
+
+  *is_view = contiguous && size > 0;
+  if (*is_view) {
+    return alias_tensor(tensor, offset, out_shape, out_ndim);
+  }
+
+  Tensor* result = allocate_tensor(out_shape, out_ndim);
+  if (result == NULL) {
     fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+    return NULL;
   }
-  switch (ndim) {
-    case 1:
-      transpose_1D_tensor_cpu(tensor, result_data);
-      break;
-    case 2:
-      transpose_2D_tensor_cpu(tensor, result_data);
-      break;
-    case 3:
-      transpose_3D_tensor_cpu(tensor, result_data);
-      break;
-    default:
-      fprintf(stderr, "Transpose only supports tensors up to 3 dimensions.\n");
-      exit(-1);
+  if (size > 0) {
+    strided_copy_cpu(tensor->data + offset, shape, strides, ndim, result->data);
   }
-  return create_tensor(result_data, shape, ndim);
+  return result;
 }
 
-Tensor* scalar_mul_tensor(Tensor* tensor, float scalar) {
-  int ndim = tensor->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
+Tensor* slice_backward_tensor(Tensor* grad_output, const int* input_shape, const int* start, const int* step) {
+  int ndim = grad_output->ndim;
+  Tensor* result = allocate_tensor(input_shape, ndim);
+  if (result == NULL) {
     fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+    return NULL;
+  }
+  long offset;
+  int strides[TENSOR_MAX_DIMS];
+  if (ndim > TENSOR_MAX_DIMS ||
+      !make_slice(result->shape, result->strides, ndim, start, step, grad_output->shape, &offset, strides)) {
+    free_tensor(result);
+    return NULL;
   }
 
-  for (int i = 0; i < ndim; i++) {
-    shape[i] = tensor->shape[i];
+  zeros_like_tensor_cpu(result, result->data);
+  if (grad_output->size > 0) {
+    strided_assign_cpu(grad_output->data, grad_output->shape, strides, ndim, result->data + offset);
   }
-  float* result_data = (float*)malloc(tensor->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+  return result;
+}
+
+// Index ops view a tensor as [outer, shape[dim], inner]
+
+static bool split_at_dim(const Tensor* tensor, int dim, long* outer, long* inner, const char* op) {
+  if (dim < 0 || dim >= tensor->ndim) {
+    fprintf(stderr, "%s dimension %d is out of range for a %dD tensor\n", op, dim, tensor->ndim);
+    return false;
   }
-  scalar_mul_tensor_cpu(tensor, scalar, result_data);
-  return create_tensor(result_data, shape, ndim);
+  *outer = 1;
+  *inner = 1;
+  for (int i = 0; i < dim; i++) {
+    *outer *= tensor->shape[i];
+  }
+  for (int i = dim + 1; i < tensor->ndim; i++) {
+    *inner *= tensor->shape[i];
+  }
+  return true;
 }
 
-Tensor* matmul_tensor(Tensor* tensor1, Tensor* tensor2) {
-  // MxN @ NxP = MxP
-  // Check if tensors have compatible shapes for matrix multiplication
-  if (tensor1->shape[1] != tensor2->shape[0]) {
-    fprintf(stderr,
-            "Incompatible shapes for matrix multiplication %dx%d and %dx%d\n",
-            tensor1->shape[0], tensor1->shape[1], tensor2->shape[0],
-            tensor2->shape[1]);
-    exit(1);
+static bool check_indices(const int* index, long count, int dim_size, const char* op) {
+  for (long i = 0; i < count; i++) {
+    if (index[i] < 0 || index[i] >= dim_size) {
+      fprintf(stderr, "%s index %d is out of bounds for a dimension of size %d\n", op, index[i], dim_size);
+      return false;
+    }
   }
+  return true;
+}
 
-  int ndim = tensor1->ndim + tensor2->ndim - 2;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
+// Shape of 'tensor' with dimension 'dim' resized to 'size'
+static Tensor* allocate_resized(const Tensor* tensor, int dim, int size) {
+  int shape[TENSOR_MAX_DIMS];
+  memcpy(shape, tensor->shape, tensor->ndim * sizeof(int));
+  shape[dim] = size;
+  Tensor* result = allocate_tensor(shape, tensor->ndim);
+  if (result == NULL) {
     fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
   }
-  for (int i = 0; i < tensor1->ndim - 1; i++) {
-    shape[i] = tensor1->shape[i];
+  return result;
+}
+
+Tensor* index_select_tensor(Tensor* input, int dim, const int* index, int count) {
+  long outer, inner;
+  if (!split_at_dim(input, dim, &outer, &inner, "index_select") ||
+      !check_indices(index, count, input->shape[dim], "index_select")) {
+    return NULL;
+  }
+  Tensor* result = allocate_resized(input, dim, count);
+  if (result == NULL) {
+    return NULL;
   }
-  for (int i = tensor1->ndim - 1; i < ndim; i++) {
-    shape[i] = tensor2->shape[i - tensor1->ndim + 2];
+  if (result->size > 0) {
+    index_select_cpu(input->data, outer, input->shape[dim], inner, index, count, result->data);
   }
+  return result;
+}
 
-  int size = 1;
-  for (int i = 0; i < ndim; i++) {
-    size *= shape[i];
+Tensor* index_select_backward_tensor(Tensor* grad_output, int dim, const int* index, int count, int dim_size) {
+  long outer, inner;
+  if (!split_at_dim(grad_output, dim, &outer, &inner, "index_select backward") ||
+      !check_indices(index, count, dim_size, "index_select backward")) {
+    return NULL;
+  }
+  if (grad_output->shape[dim] != count) {
+    fprintf(stderr, "index_select backward got %d indices for a gradient of %d rows\n", count,
+            grad_output->shape[dim]);
+    return NULL;
+  }
+  Tensor* result = allocate_resized(grad_output, dim, dim_size);
+  if (result == NULL) {
+    return NULL;
   }
+  zeros_like_tensor_cpu(result, result->data);
+  if (grad_output->size > 0) {
+    index_add_cpu(grad_output->data, outer, count, inner, index, dim_size, result->data);
+  }
+  return result;
+}
 
-  float* result_data = (float*)malloc(size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+// gather/scatter_add take an index shaped like the gathered or scattered
+// values: it may differ from the tensor only along 'dim'
+static bool check_index_shape(const Tensor* tensor, int dim, const int* index_shape, const char* op) {
+  for (int i = 0; i < tensor->ndim; i++) {
+    if (i != dim && index_shape[i] != tensor->shape[i]) {
+      fprintf(stderr, "%s index size %d does not match size %d at dimension %d\n", op, index_shape[i],
+              tensor->shape[i], i);
+      return false;
+    }
   }
+  return true;
+}
 
-  matmul_tensor_cpu(tensor1, tensor2, result_data);
-  return create_tensor(result_data, shape, ndim);
+Tensor* gather_tensor(Tensor* input, int dim, const int* index, const int* index_shape) {
+  long outer, inner;
+  if (!split_at_dim(input, dim, &outer, &inner, "gather") ||
+      !check_index_shape(input, dim, index_shape, "gather") ||
+      !check_indices(index, outer * index_shape[dim] * inner, input->shape[dim], "gather")) {
+    return NULL;
+  }
+  Tensor* result = allocate_resized(input, dim, index_shape[dim]);
+  if (result == NULL) {
+    return NULL;
+  }
+  if (result->size > 0) {
+    gather_cpu(input->data, outer, input->shape[dim], inner, index, index_shape[dim], result->data);
+  }
+  return result;
 }
-Tensor* tensor_pow_scalar(Tensor* tensor, float exponent) {
-  int ndim = tensor->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+
+Tensor* scatter_add_tensor(Tensor* tensor, int dim, const int* index, Tensor* src) {
+  long outer, inner;
+  if (src->ndim != tensor->ndim) {
+    fprintf(stderr, "scatter_add source has %d dimensions, expected %d\n", src->ndim, tensor->ndim);
+    return NULL;
   }
+  if (!split_at_dim(tensor, dim, &outer, &inner, "scatter_add") ||
+      !check_index_shape(tensor, dim, src->shape, "scatter_add") ||
+      !check_indices(index, src->size, tensor->shape[dim], "scatter_add")) {
+    return NULL;
+  }
+  Tensor* result = allocate_like(tensor);
+  if (result == NULL) {
+    return NULL;
+  }
+  assign_tensor_cpu(tensor, result);
+  if (src->size > 0) {
+    scatter_add_cpu(src->data, outer, src->shape[dim], inner, index, tensor->shape[dim], result->data);
+  }
+  return result;
+}
 
-  for (int i = 0; i < ndim; i++) {
-    shape[i] = tensor->shape[i];
+Tensor* gather_backward_tensor(Tensor* grad_output, int dim, const int* index, int dim_size) {
+  long outer, inner;
+  if (!split_at_dim(grad_output, dim, &outer, &inner, "gather backward") ||
+      !check_indices(index, grad_output->size, dim_size, "gather backward")) {
+    return NULL;
   }
-  float* result_data = (float*)malloc(tensor->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+  Tensor* result = allocate_resized(grad_output, dim, dim_size);
+  if (result == NULL) {
+    return NULL;
   }
-  tensor_pow_scalar_cpu(tensor, exponent, result_data);
-  return create_tensor(result_data, shape, ndim);
+  zeros_like_tensor_cpu(result, result->data);
+  if (grad_output->size > 0) {
+    scatter_add_cpu(grad_output->data, outer, grad_output->shape[dim], inner, index, dim_size, result->data);
+  }
+  return result;
 }
 
-Tensor* scalar_pow_tensor(float base, Tensor* tensor) {
-  int ndim = tensor->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+Tensor* scalar_mul_tensor(Tensor* tensor, float scalar) {
+  Tensor* result = allocate_like(tensor);
+  if (result == NULL) {
+    return NULL;
   }
+  scalar_mul_tensor_cpu(tensor, scalar, result->data);
+  return result;
+}
 
-  for (int i = 0; i < ndim; i++) {
-    shape[i] = tensor->shape[i];
+typedef struct {
+  int batch;
+  int M;
+  int N;
+  int K;
+  long stride_a;
+  long stride_b;
+  const Tensor* batch_source;  // operand whose leading dims shape the result
+} MatmulDims;
+
+static bool make_matmul_dims(const Tensor* a, const Tensor* b, bool trans_a, bool trans_b, MatmulDims* d) {
+  // Operands are [..., rows, cols]; leading dims are flattened into one
+  // batch. A 2D operand (or one with a batch of 1) is broadcast.
+  if (a->ndim < 2 || b->ndim < 2) {
+    fprintf(stderr, "Matrix multiplication requires at least 2D tensors (got %dD and %dD)\n", a->ndim,
+            b->ndim);
+    return false;
+  }
+
+  int a_rows = a->shape[a->ndim - 2], a_cols = a->shape[a->ndim - 1];
+  int b_rows = b->shape[b->ndim - 2], b_cols = b->shape[b->ndim - 1];
+  d->M = trans_a ? a_cols : a_rows;
+  d->K = trans_a ? a_rows : a_cols;
+  d->N = trans_b ? b_rows : b_cols;
+  int k = trans_b ? b_cols : b_rows;
+  if (d->K != k) {
+    fprintf(stderr, "Incompatible shapes for matrix multiplication %dx%d and %dx%d\n", d->M, d->K, k,
+            d->N);
+    return false;
+  }
+
+  int batch_a = a->size / (a_rows * a_cols > 0 ? a_rows * a_cols : 1);
+  int batch_b = b->size / (b_rows * b_cols > 0 ? b_rows * b_cols : 1);
+  if (batch_a != batch_b && batch_a != 1 && batch_b != 1) {
+    fprintf(stderr, "Matrix multiplication batch sizes %d and %d cannot be broadcast\n", batch_a, batch_b);
+    return false;
+  }
+  d->batch = batch_a > batch_b ? batch_a : batch_b;
+  d->stride_a = batch_a == 1 ? 0 : (long)a_rows * a_cols;
+  d->stride_b = batch_b == 1 ? 0 : (long)b_rows * b_cols;
+  d->batch_source = batch_a > batch_b || (batch_a == batch_b && a->ndim >= b->ndim) ? a : b;
+  return true;
+}
+
+Tensor* batched_matmul_tensor(Tensor* tensor1, Tensor* tensor2, bool trans_a, bool trans_b) {
+  // op(A) @ op(B) with op() an optional transpose of the last two dims,
+  // read in place through the leading dimension rather than copied
+  MatmulDims d;
+  if (!make_matmul_dims(tensor1, tensor2, trans_a, trans_b, &d)) {
+    return NULL;
   }
-  float* result_data = (float*)malloc(tensor->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+
+  int ndim = d.batch_source->ndim;
+  int shape[TENSOR_MAX_DIMS];
+  if (ndim > TENSOR_MAX_DIMS) {
+    fprintf(stderr, "Matrix multiplication supports tensors up to %d dimensions\n", TENSOR_MAX_DIMS);
+    return NULL;
   }
-  scalar_pow_tensor_cpu(base, tensor, result_data);
-  return create_tensor(result_data, shape, ndim);
+  for (int i = 0; i < ndim - 2; i++) {
+    shape[i] = d.batch_source->shape[i];
+  }
+  shape[ndim - 2] = d.M;
+  shape[ndim - 1] = d.N;
+
+  Tensor* result = allocate_tensor(shape, ndim);
+  if (result == NULL) {
+    return NULL;
+  }
+  batched_gemm_cpu(trans_a, trans_b, d.batch, d.M, d.N, d.K, 1.0f, tensor1->data,
+                   tensor1->shape[tensor1->ndim - 1], d.stride_a, tensor2->data,
+                   tensor2->shape[tensor2->ndim - 1], d.stride_b, 0.0f, result->data, d.N,
+                   (long)d.M * d.N);
+  return result;
 }
 
-Tensor* sigmoid_tensor(Tensor* tensor) {
-  int ndim = tensor->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
+int matmul_accumulate_tensor(Tensor* tensor1, Tensor* tensor2, bool trans_a, bool trans_b, float alpha,
+                             float beta, Tensor* result) {
+  // result = alpha * op(A) @ op(B) + beta * result, in place. If result holds
+  // a single matrix while the product is batched, the batch is summed into
+  // it (the gradient of a broadcast operand).
+  MatmulDims d;
+  if (!make_matmul_dims(tensor1, tensor2, trans_a, trans_b, &d)) {
+    return -1;
+  }
+  if (result->ndim < 2 || result->shape[result->ndim - 2] != d.M || result->shape[result->ndim - 1] != d.N) {
+    fprintf(stderr, "Matrix multiplication output does not have shape %dx%d\n", d.M, d.N);
+    return -1;
+  }
+  int result_batch = result->size / (d.M * d.N > 0 ? d.M * d.N : 1);
+  if (result_batch != 1 && result_batch != d.batch) {
+    fprintf(stderr, "Matrix multiplication output batch %d does not match %d\n", result_batch, d.batch);
+    return -1;
+  }
+
+  batched_gemm_cpu(trans_a, trans_b, d.batch, d.M, d.N, d.K, alpha, tensor1->data,
+                   tensor1->shape[tensor1->ndim - 1], d.stride_a, tensor2->data,
+                   tensor2->shape[tensor2->ndim - 1], d.stride_b, beta, result->data, d.N,
+                   result_batch == 1 ? 0 : (long)d.M * d.N);
+  return 0;
+}
+
+Tensor* matmul_tensor(Tensor* tensor1, Tensor* tensor2) {
+  // MxN @ NxP = MxP, batched over any leading dims
+  Tensor* result = batched_matmul_tensor(tensor1, tensor2, false, false);
+  if (result == NULL) {
     exit(1);
   }
+  return result;
+}
+Tensor* tensor_pow_scalar(Tensor* tensor, float exponent) {
+  Tensor* result = allocate_like(tensor);
+  if (result == NULL) {
+    return NULL;
+  }
+  tensor_pow_scalar_cpu(tensor, exponent, result->data);
+  return result;
+}
 
-  for (int i = 0; i < ndim; i++) {
-    shape[i] = tensor->shape[i];
+Tensor* scalar_pow_tensor(float base, Tensor* tensor) {
+  Tensor* result = allocate_like(tensor);
+  if (result == NULL) {
+    return NULL;
   }
+  scalar_pow_tensor_cpu(base, tensor, result->data);
+  return result;
+}
 
-  float* result_data = (float*)malloc(tensor->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+Tensor* sigmoid_tensor(Tensor* tensor) {
+  Tensor* result = allocate_like(tensor);
+  if (result == NULL) {
+    return NULL;
   }
-  sigmoid_tensor_cpu(tensor, result_data);
-  return create_tensor(result_data, shape, ndim);
+  sigmoid_tensor_cpu(tensor, result->data);
+  return result;
 }
 
 Tensor* sum_tensor(Tensor* tensor, int axis, bool keepdim) {
@@ -546,132 +745,288 @@ Tensor* sum_tensor(Tensor* tensor, int axis, bool keepdim) {
 }
 
 Tensor* tensor_div_scalar(Tensor* tensor, float scalar) {
-  int ndim = tensor->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+  Tensor* result = allocate_like(tensor);
+  if (result == NULL) {
+    return NULL;
   }
+  tensor_div_scalar_cpu(tensor, scalar, result->data);
+  return result;
+}
 
-  for (int i = 0; i < ndim; i++) {
-    shape[i] = tensor->shape[i];
+Tensor* tensor_div_tensor(Tensor* tensor1, Tensor* tensor2) {
+  if (!check_same_shape(tensor1, tensor2, "element-wise division")) {
+    return NULL;
   }
+  Tensor* result = allocate_like(tensor1);
+  if (result == NULL) {
+    return NULL;
+  }
+  tensor_div_tensor_cpu(tensor1, tensor2, result->data);
+  return result;
+}
 
-  float* result_data = (float*)malloc(tensor->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+Tensor* log_tensor(Tensor* tensor) {
+  Tensor* result = allocate_like(tensor);
+  if (result == NULL) {
+    return NULL;
   }
-  tensor_div_scalar_cpu(tensor, scalar, result_data);
-  return create_tensor(result_data, shape, ndim);
+  log_tensor_cpu(tensor, result->data);
+  return result;
 }
 
-Tensor* tensor_div_tensor(Tensor* tensor1, Tensor* tensor2) {
-  if (tensor1->ndim != tensor2->ndim) {
-    fprintf(stderr,
-            "Tensors must have the same number of dimensions %d and %d for "
-            "element-wise division\n",
-            tensor1->ndim, tensor2->ndim);
-    exit(1);
+Tensor* transpose_axes_tensor(Tensor* tensor, int axis1, int axis2) {
+  if (axis1 < 0 || axis1 >= tensor->ndim || axis2 < 0 || axis2 >= tensor->ndim) {
+    fprintf(stderr, "Transpose axes (%d, %d) out of range for a %dD tensor\n", axis1, axis2,
+            tensor->ndim);
+    return NULL;
   }
 
-  int ndim = tensor1->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
+  int dims[TENSOR_MAX_DIMS];
+  for (int i = 0; i < tensor->ndim && i < TENSOR_MAX_DIMS; i++) {
+    dims[i] = i;
+  }
+  dims[axis1] = axis2;
+  dims[axis2] = axis1;
+  return permute_tensor(tensor, dims);
+}
+void make_contiguous(Tensor* tensor) {
+  int* new_strides = (int*)malloc(tensor->ndim * sizeof(int));
+  if (new_strides == NULL) {
     fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
   }
 
-  for (int i = 0; i < ndim; i++) {
-    if (tensor1->shape[i] != tensor2->shape[i]) {
-      fprintf(stderr,
-              "Tensors must have the same shape %d and %d at index %d for "
-              "division\n",
-              tensor1->shape[i], tensor2->shape[i], i);
-      exit(1);
-    }
-    shape[i] = tensor1->shape[i];
+  // Calculate new strides assuming C-contiguous order
+  int stride = 1;
+  for (int i = tensor->ndim - 1; i >= 0; i--) {
+    new_strides[i] = stride;
+    stride *= tensor->shape[i];
   }
 
-  float* result_data = (float*)malloc(tensor1->size * sizeof(float));
+  float* result_data = tensor_data_alloc(tensor->size);
   if (result_data == NULL) {
     fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
   }
-  tensor_div_tensor_cpu(tensor1, tensor2, result_data);
-  return create_tensor(result_data, shape, ndim);
+  make_contiguous_tensor_cpu(tensor, result_data, new_strides);
 }
 
-Tensor* log_tensor(Tensor* tensor) {
-  int ndim = tensor->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+static bool make_conv2d_shape(const Tensor* input, const Tensor* weight, int stride_h, int stride_w,
+                              int pad_h, int pad_w, int dilation_h, int dilation_w, int groups,
+                              Conv2dShape* s) {
+  if (input->ndim != 4 || weight->ndim != 4) {
+    fprintf(stderr, "conv2d expects a 4D NCHW input and a 4D weight (got %dD and %dD)\n",
+            input->ndim, weight->ndim);
+    return false;
+  }
+  if (groups <= 0 || input->shape[1] % groups != 0 || weight->shape[0] % groups != 0) {
+    fprintf(stderr, "conv2d channels (%d in, %d out) must be divisible by groups %d\n",
+            input->shape[1], weight->shape[0], groups);
+    return false;
+  }
+  if (weight->shape[1] * groups != input->shape[1]) {
+    fprintf(stderr, "conv2d weight expects %d input channels but input has %d\n",
+            weight->shape[1] * groups, input->shape[1]);
+    return false;
+  }
+  if (stride_h <= 0 || stride_w <= 0 || dilation_h <= 0 || dilation_w <= 0 || pad_h < 0 || pad_w < 0) {
+    fprintf(stderr, "conv2d stride and dilation must be positive and padding non-negative\n");
+    return false;
+  }
+
+  s->batch = input->shape[0];
+  s->in_channels = input->shape[1];
+  s->in_h = input->shape[2];
+  s->in_w = input->shape[3];
+  s->out_channels = weight->shape[0];
+  s->kernel_h = weight->shape[2];
+  s->kernel_w = weight->shape[3];
+  s->stride_h = stride_h;
+  s->stride_w = stride_w;
+  s->pad_h = pad_h;
+  s->pad_w = pad_w;
+  s->dilation_h = dilation_h;
+  s->dilation_w = dilation_w;
+  s->groups = groups;
+  s->out_h = (s->in_h + 2 * pad_h - dilation_h * (s->kernel_h - 1) - 1) / stride_h + 1;
+  s->out_w = (s->in_w + 2 * pad_w - dilation_w * (s->kernel_w - 1) - 1) / stride_w + 1;
+
+  if (s->out_h <= 0 || s->out_w <= 0) {
+    fprintf(stderr, "conv2d kernel %dx%d is larger than the padded input %dx%d\n", s->kernel_h,
+            s->kernel_w, s->in_h + 2 * pad_h, s->in_w + 2 * pad_w);
+    return false;
+  }
+  return true;
+}
+
+Tensor* conv2d_tensor(Tensor* input, Tensor* weight, Tensor* bias, int stride_h, int stride_w,
+                      int pad_h, int pad_w, int dilation_h, int dilation_w, int groups) {
+  Conv2dShape s;
+  if (!make_conv2d_shape(input, weight, stride_h, stride_w, pad_h, pad_w, dilation_h, dilation_w,
+                         groups, &s)) {
+    return NULL;
+  }
+  if (bias != NULL && bias->size != s.out_channels) {
+    fprintf(stderr, "conv2d bias has %d elements but there are %d output channels\n", bias->size,
+            s.out_channels);
+    return NULL;
   }
 
-  for (int i = 0; i < ndim; i++) {
-    shape[i] = tensor->shape[i];
+  int shape[4] = {s.batch, s.out_channels, s.out_h, s.out_w};
+  Tensor* result = allocate_tensor(shape, 4);
+  if (result == NULL) {
+    return NULL;
   }
+  conv2d_cpu(input->data, weight->data, bias != NULL ? bias->data : NULL, &s, result->data);
+  return result;
+}
 
-  float* result_data = (float*)malloc(tensor->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+Tensor* conv2d_backward_input_tensor(Tensor* grad_output, Tensor* input, Tensor* weight, int stride_h,
+                                     int stride_w, int pad_h, int pad_w, int dilation_h,
+                                     int dilation_w, int groups) {
+  Conv2dShape s;
+  if (!make_conv2d_shape(input, weight, stride_h, stride_w, pad_h, pad_w, dilation_h, dilation_w,
+                         groups, &s)) {
+    return NULL;
   }
-  log_tensor_cpu(tensor, result_data);
-  return create_tensor(result_data, shape, ndim);
+
+  Tensor* result = allocate_tensor(input->shape, 4);
+  if (result == NULL) {
+    return NULL;
+  }
+  conv2d_backward_input_cpu(grad_output->data, weight->data, &s, result->data);
+  return result;
 }
 
-Tensor* transpose_axes_tensor(Tensor* tensor, int axis1, int axis2) {
-  int ndim = tensor->ndim;
-  int* shape = (int*)malloc(ndim * sizeof(int));
-  if (shape == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(-1);
+Tensor* conv2d_backward_weight_tensor(Tensor* grad_output, Tensor* input, Tensor* weight, int stride_h,
+                                      int stride_w, int pad_h, int pad_w, int dilation_h,
+                                      int dilation_w, int groups) {
+  Conv2dShape s;
+  if (!make_conv2d_shape(input, weight, stride_h, stride_w, pad_h, pad_w, dilation_h, dilation_w,
+                         groups, &s)) {
+    return NULL;
   }
 
-  for (int i = 0; i < ndim; i++) {
-    shape[i] = tensor->shape[i];
+  Tensor* result = allocate_tensor(weight->shape, 4);
+  if (result == NULL) {
+    return NULL;
   }
+  conv2d_backward_weight_cpu(grad_output->data, input->data, &s, result->data);
+  return result;
+}
 
-  shape[axis1] = tensor->shape[axis2];
-  shape[axis2] = tensor->shape[axis1];
+Tensor* conv2d_backward_bias_tensor(Tensor* grad_output) {
+  if (grad_output->ndim != 4) {
+    fprintf(stderr, "conv2d bias gradient expects a 4D gradient (got %dD)\n", grad_output->ndim);
+    return NULL;
+  }
 
-  int size = tensor->size;
+  Conv2dShape s;
+  s.batch = grad_output->shape[0];
+  s.out_channels = grad_output->shape[1];
+  s.out_h = grad_output->shape[2];
+  s.out_w = grad_output->shape[3];
 
-  float* result_data = (float*)malloc(size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
+  Tensor* result = allocate_tensor(&s.out_channels, 1);
+  if (result == NULL) {
+    return NULL;
   }
-  assign_tensor_cpu(tensor, result_data);
+  conv2d_backward_bias_cpu(grad_output->data, &s, result->data);
+  return result;
+}
 
-  Tensor* new_tensor = create_tensor(result_data, shape, ndim);
-  for (int i = 0; i < ndim; i++) {
-    new_tensor->strides[i] = tensor->strides[i];
+static bool make_pool2d_shape(const Tensor* input, int kernel_h, int kernel_w, int stride_h,
+                              int stride_w, int pad_h, int pad_w, Pool2dShape* s) {
+  if (input->ndim != 4) {
+    fprintf(stderr, "pool2d expects a 4D NCHW input (got %dD)\n", input->ndim);
+    return false;
+  }
+  if (kernel_h <= 0 || kernel_w <= 0 || stride_h <= 0 || stride_w <= 0) {
+    fprintf(stderr, "pool2d kernel size and stride must be positive\n");
+    return false;
+  }
+  if (pad_h < 0 || pad_w < 0 || 2 * pad_h > kernel_h || 2 * pad_w > kernel_w) {
+    fprintf(stderr, "pool2d padding must be non-negative and at most half the kernel size\n");
+    return false;
+  }
+
+  s->batch = input->shape[0];
+  s->channels = input->shape[1];
+  s->in_h = input->shape[2];
+  s->in_w = input->shape[3];
+  s->kernel_h = kernel_h;
+  s->kernel_w = kernel_w;
+  s->stride_h = stride_h;
+  s->stride_w = stride_w;
+  s->pad_h = pad_h;
+  s->pad_w = pad_w;
+  s->out_h = (s->in_h + 2 * pad_h - kernel_h) / stride_h + 1;
+  s->out_w = (s->in_w + 2 * pad_w - kernel_w) / stride_w + 1;
+
+  if (s->out_h <= 0 || s->out_w <= 0) {
+    fprintf(stderr, "pool2d kernel %dx%d is larger than the padded input %dx%d\n", kernel_h,
+            kernel_w, s->in_h + 2 * pad_h, s->in_w + 2 * pad_w);
+    return false;
+  }
+  return true;
+}
+
+Tensor* max_pool2d_tensor(Tensor* input, int kernel_h, int kernel_w, int stride_h, int stride_w,
+                          int pad_h, int pad_w) {
+  Pool2dShape s;
+  if (!make_pool2d_shape(input, kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w, &s)) {
+    return NULL;
+  }
+
+  int shape[4] = {s.batch, s.channels, s.out_h, s.out_w};
+  Tensor* result = allocate_tensor(shape, 4);
+  if (result == NULL) {
+    return NULL;
   }
-  new_tensor->strides[axis1] = tensor->strides[axis2];
-  new_tensor->strides[axis2] = tensor->strides[axis1];
-  make_contiguous(new_tensor);
-  return new_tensor;
+  max_pool2d_cpu(input->data, &s, result->data);
+  return result;
 }
-void make_contiguous(Tensor* tensor) {
-  int* new_strides = (int*)malloc(tensor->ndim * sizeof(int));
-  if (new_strides == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
+
+Tensor* max_pool2d_backward_tensor(Tensor* grad_output, Tensor* input, int kernel_h, int kernel_w,
+                                   int stride_h, int stride_w, int pad_h, int pad_w) {
+  Pool2dShape s;
+  if (!make_pool2d_shape(input, kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w, &s)) {
+    return NULL;
   }
 
-  // Calculate new strides assuming C-contiguous order
-  int stride = 1;
-  for (int i = tensor->ndim - 1; i >= 0; i--) {
-    new_strides[i] = stride;
-    stride *= tensor->shape[i];
+  Tensor* result = allocate_tensor(input->shape, 4);
+  if (result == NULL) {
+    return NULL;
   }
+  max_pool2d_backward_cpu(grad_output->data, input->data, &s, result->data);
+  return result;
+}
 
-  float* result_data = (float*)malloc(tensor->size * sizeof(float));
-  if (result_data == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
+Tensor* avg_pool2d_tensor(Tensor* input, int kernel_h, int kernel_w, int stride_h, int stride_w,
+                          int pad_h, int pad_w) {
+  Pool2dShape s;
+  if (!make_pool2d_shape(input, kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w, &s)) {
+    return NULL;
   }
-  make_contiguous_tensor_cpu(tensor, result_data, new_strides);
+
+  int shape[4] = {s.batch, s.channels, s.out_h, s.out_w};
+  Tensor* result = allocate_tensor(shape, 4);
+  if (result == NULL) {
+    return NULL;
+  }
+  avg_pool2d_cpu(input->data, &s, result->data);
+  return result;
+}
+
+Tensor* avg_pool2d_backward_tensor(Tensor* grad_output, Tensor* input, int kernel_h, int kernel_w,
+                                   int stride_h, int stride_w, int pad_h, int pad_w) {
+  Pool2dShape s;
+  if (!make_pool2d_shape(input, kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w, &s)) {
+    return NULL;
+  }
+
+  Tensor* result = allocate_tensor(input->shape, 4);
+  if (result == NULL) {
+    return NULL;
+  }
+  avg_pool2d_backward_cpu(grad_output->data, &s, result->data);
+  return result;
 }
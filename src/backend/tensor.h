@@ -16,6 +16,7 @@ typedef struct {
 } Tensor;
 
 extern "C" {
+    Tensor* allocate_tensor(const int* shape, int ndim);
     Tensor* create_tensor(const float* data, const int* shape, int ndim);
     void free_tensor(Tensor* tensor);
     float get_element(const Tensor* tensor, const int* indices);
@@ -27,7 +28,21 @@ extern "C" {
     Tensor* ones_like_tensor(Tensor* tensor);
     Tensor* zeros_like_tensor(Tensor* tensor);
     Tensor* transpose_tensor(Tensor* tensor);
+    Tensor* permute_tensor(Tensor* tensor, const int* dims);
+    void free_tensor_view(Tensor* tensor);
+    Tensor* view_tensor(Tensor* tensor, const int* shape, int ndim);
+    Tensor* slice_tensor(Tensor* tensor, const int* start, const int* step, const int* shape, const int* out_shape,
+                         int out_ndim, bool* is_view);
+    Tensor* slice_backward_tensor(Tensor* grad_output, const int* input_shape, const int* start, const int* step);
+    Tensor* index_select_tensor(Tensor* input, int dim, const int* index, int count);
+    Tensor* index_select_backward_tensor(Tensor* grad_output, int dim, const int* index, int count, int dim_size);
+    Tensor* gather_tensor(Tensor* input, int dim, const int* index, const int* index_shape);
+    Tensor* gather_backward_tensor(Tensor* grad_output, int dim, const int* index, int dim_size);
+    Tensor* scatter_add_tensor(Tensor* tensor, int dim, const int* index, Tensor* src);
     Tensor* matmul_tensor(Tensor* tensor1, Tensor* tensor2);
+    Tensor* batched_matmul_tensor(Tensor* tensor1, Tensor* tensor2, bool trans_a, bool trans_b);
+    int matmul_accumulate_tensor(Tensor* tensor1, Tensor* tensor2, bool trans_a, bool trans_b, float alpha,
+                                 float beta, Tensor* result);
     Tensor* scalar_mul_tensor(Tensor* tensor, float scalar);
     Tensor* scalar_pow_tensor(float base, Tensor* tensor);
     Tensor* tensor_pow_scalar(Tensor* tensor, float exponent);
@@ -38,6 +53,23 @@ extern "C" {
     Tensor* log_tensor(Tensor* tensor);
     Tensor* transpose_axes_tensor(Tensor* tensor, int axis1, int axis2);
     void make_contiguous(Tensor* tensor);
+    Tensor* conv2d_tensor(Tensor* input, Tensor* weight, Tensor* bias, int stride_h, int stride_w,
+                          int pad_h, int pad_w, int dilation_h, int dilation_w, int groups);
+    Tensor* conv2d_backward_input_tensor(Tensor* grad_output, Tensor* input, Tensor* weight, int stride_h,
+                                         int stride_w, int pad_h, int pad_w, int dilation_h,
+                                         int dilation_w, int groups);
+    Tensor* conv2d_backward_weight_tensor(Tensor* grad_output, Tensor* input, Tensor* weight, int stride_h,
+                                          int stride_w, int pad_h, int pad_w, int dilation_h,
+                                          int dilation_w, int groups);
+    Tensor* conv2d_backward_bias_tensor(Tensor* grad_output);
+    Tensor* max_pool2d_tensor(Tensor* input, int kernel_h, int kernel_w, int stride_h, int stride_w,
+                              int pad_h, int pad_w);
+    Tensor* max_pool2d_backward_tensor(Tensor* grad_output, Tensor* input, int kernel_h, int kernel_w,
+                                       int stride_h, int stride_w, int pad_h, int pad_w);
+    Tensor* avg_pool2d_tensor(Tensor* input, int kernel_h, int kernel_w, int stride_h, int stride_w,
+                              int pad_h, int pad_w);
+    Tensor* avg_pool2d_backward_tensor(Tensor* grad_output, Tensor* input, int kernel_h, int kernel_w,
+                                       int stride_h, int stride_w, int pad_h, int pad_w);
 }
 
 #endif
@@ -0,0 +1,82 @@
+import ctypes
+from .tensor import Tensor, CTensor
+
+class CProcessGroup(ctypes.Structure):
+    _fields_ = [
+        ('shm', ctypes.c_void_p),
+        ('shm_bytes', ctypes.c_long),
+        ('slots', ctypes.POINTER(ctypes.c_float)),
+        ('result', ctypes.POINTER(ctypes.c_float)),
+        ('capacity', ctypes.c_long),
+        ('rank', ctypes.c_int),
+        ('world_size', ctypes.c_int),
+    ]
+
+# Signatures are declared once at import, not on every call (all-reduce runs every step)
+_C = Tensor._C
+_C.process_group_init.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_int, ctypes.c_long]
+_C.process_group_init.restype = ctypes.POINTER(CProcessGroup)
+
+_C.process_group_barrier.argtypes = [ctypes.POINTER(CProcessGroup)]
+_C.process_group_barrier.restype = None
+
+_C.process_group_allreduce.argtypes = [ctypes.POINTER(CProcessGroup),
+                                       ctypes.POINTER(ctypes.POINTER(CTensor)),
+                                       ctypes.c_int, ctypes.c_bool]
+_C.process_group_allreduce.restype = None
+
+_C.process_group_broadcast.argtypes = [ctypes.POINTER(CProcessGroup),
+                                       ctypes.POINTER(ctypes.POINTER(CTensor)),
+                                       ctypes.c_int, ctypes.c_int]
+_C.process_group_broadcast.restype = None
+
+_C.process_group_destroy.argtypes = [ctypes.POINTER(CProcessGroup)]
+_C.process_group_destroy.restype = None
+
+class ProcessGroup:
+    """
+    Processes on one host that exchange tensors through POSIX shared memory.
+    Every rank must construct it with the same name, world_size and capacity,
+    and issue collectives in the same order.
+
+    Example (one process per NUMA node):
+        group = ProcessGroup('/train', rank, world_size)
+        group.allreduce([t1, t2], average=True)
+    """
+    _C = Tensor._C
+
+    def __init__(self, name, rank, world_size, capacity=1 << 20):
+        if not name.startswith('/'):
+            name = '/' + name
+
+        self.group = ProcessGroup._C.process_group_init(name.encode('utf-8'), rank, world_size, capacity)
+        if not self.group:
+            raise RuntimeError("Could not join process group {} as rank {}".format(name, rank))
+
+        self.rank = rank
+        self.world_size = world_size
+        self.capacity = capacity
+
+    @staticmethod
+    def _tensor_array(tensors):
+        return (ctypes.POINTER(CTensor) * len(tensors))(*[t.tensor._as_parameter_ for t in tensors])
+
+    def barrier(self):
+        ProcessGroup._C.process_group_barrier(self.group)
+
+    def allreduce(self, tensors, average=False):
+        """
+        Sum (or average) each tensor element-wise across ranks, in place
+        """
+        ProcessGroup._C.process_group_allreduce(self.group, self._tensor_array(tensors), len(tensors), average)
+
+    def broadcast(self, tensors, root=0):
+        """
+        Overwrite each tensor with its value on rank 'root', in place
+        """
+        ProcessGroup._C.process_group_broadcast(self.group, self._tensor_array(tensors), len(tensors), root)
+
+    def destroy(self):
+        if self.group:
+            ProcessGroup._C.process_group_destroy(self.group)
+            self.group = None
@@ -0,0 +1,39 @@
+import ctypes
+from .tensor import Tensor
+from . import _backend
+
+PLACEMENTS = {'first_touch': 0, 'interleave': 1, 'local': 2}
+
+def set_placement(policy, node=-1):
+    """
+    Choose where pages of large tensor buffers are placed on NUMA hosts
+
+    'first_touch': on the node of the thread that first writes them (default);
+                   kernels initialize buffers with the same static partitioning
+                   they compute with, so this suits one process spanning sockets
+    'interleave':  round-robin over all online nodes
+    'local':       prefer 'node', or the allocating thread's node if node < 0
+    """
+    if policy not in PLACEMENTS:
+        raise ValueError("Unknown placement policy '{}', expected one of {}".format(policy, list(PLACEMENTS)))
+
+    # Queued ops allocate when they run: let them finish under the old policy
+    _backend.synchronize()
+
+    Tensor._C.set_tensor_placement.argtypes = [ctypes.c_int, ctypes.c_int]
+    Tensor._C.set_tensor_placement.restype = ctypes.c_int
+
+    if Tensor._C.set_tensor_placement(PLACEMENTS[policy], node) != 0:
+        raise ValueError("Could not set placement '{}' on node {}".format(policy, node))
+
+def set_huge_page_threshold(nbytes):
+    """
+    Buffers of at least 'nbytes' are mapped 2MB-aligned with a transparent huge page hint
+    and follow the placement policy; 0 disables this and keeps every buffer on the heap
+    """
+    _backend.synchronize()
+
+    Tensor._C.set_huge_page_threshold.argtypes = [ctypes.c_long]
+    Tensor._C.set_huge_page_threshold.restype = None
+
+    Tensor._C.set_huge_page_threshold(nbytes)
@@ -1,4 +1,7 @@
 from .modules import *
 from .activation import *
 from .loss import *
-from .parameter import *
\ No newline at end of file
+from .parameter import *
+from .parallel import *
+from .checkpoint import *
+from . import init
\ No newline at end of file
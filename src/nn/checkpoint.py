@@ -0,0 +1,123 @@
+from .module import Module
+from src.tensor import Tensor
+from src.rng import get_rng_state
+from src.autograd.functions import CheckpointBackward
+
+def checkpoint(function, *inputs):
+    """
+    Run function(*inputs) keeping only its inputs and output for backward: the
+    activations in between are freed once it returns and recomputed during
+    backward, so memory goes down at the cost of a second forward pass
+    out = checkpoint(block, x)
+    """
+    rng_state = get_rng_state()
+    output = function(*inputs)
+    # Nothing to cut if the function built no graph or passed an input through
+    if not isinstance(output, Tensor) or output.grad_fn is None or any(output is x for x in inputs):
+        return output
+
+    output.grad_fn = CheckpointBackward(function, inputs, rng_state)
+    return output
+
+class Checkpoint(Module):
+    """
+    Wraps a module so its forward is checkpointed (see checkpoint)
+    """
+    def __init__(self, module):
+        super().__init__()
+        self.module = module
+
+    def forward(self, *inputs):
+        return checkpoint(self.module, *inputs)
+
+    def inner_repr(self):
+        return f"{self.module.get_name()}({self.module.inner_repr()})"
+
+class EveryKLayers:
+    """
+    Checkpoint policy: segments of k consecutive layers; about n / k + k
+    activations are live at once for n layers, lowest near k = sqrt(n)
+    """
+    def __init__(self, k):
+        if k < 1:
+            raise ValueError("EveryKLayers needs k >= 1, got {}".format(k))
+        self.k = k
+
+    def reset(self):
+        pass
+
+    def should_cut(self, segment):
+        return segment.layers >= self.k
+
+class MemoryBudget:
+    """
+    Checkpoint policy: a segment ends once the activations it holds plus those
+    kept at earlier segment boundaries exceed 'nbytes', so forward (and the
+    recompute of any one segment) stays within about the budget plus one layer.
+    Counts the float32 tensors saved by autograd nodes, not parameters
+    """
+    def __init__(self, nbytes):
+        self.nbytes = nbytes
+        self.stored = 0
+
+    def reset(self):
+        self.stored = 0
+
+    def should_cut(self, segment):
+        if self.stored + segment.nbytes <= self.nbytes:
+            return False
+        self.stored += segment.output.numel * 4
+        return True
+
+class Segment:
+    """
+    Layers run since the last cut, as seen by a policy's should_cut
+    """
+    def __init__(self, input, output, layers):
+        self.input = input
+        self.output = output
+        self.layers = layers
+
+    @property
+    def nbytes(self):
+        # Walks the graph from the output back to the segment input, summing
+        # the non-leaf tensors it keeps alive
+        seen = set()
+        total = self.output.numel * 4
+        stack = [self.output]
+        while stack:
+            tensor = stack.pop()
+            if tensor.grad_fn is None or isinstance(tensor.grad_fn, CheckpointBackward):
+                continue
+            for x in tensor.grad_fn.input:
+                if isinstance(x, Tensor) and x is not self.input and id(x) not in seen:
+                    seen.add(id(x))
+                    if x.grad_fn is not None:
+                        total += x.numel * 4
+                        stack.append(x)
+        return total
+
+def _run_layers(layers):
+    def run(x):
+        for layer in layers:
+            x = layer(x)
+        return x
+    return run
+
+def checkpoint_sequential(layers, x, policy):
+    """
+    Run x through layers in order, checkpointing the segments chosen by policy
+    (EveryKLayers or MemoryBudget). The last segment is never checkpointed:
+    backward needs it first, so recomputing it would save nothing
+    """
+    policy.reset()
+    start, segment_input, rng_state = 0, x, get_rng_state()
+    for i, layer in enumerate(layers):
+        x = layer(x)
+        if i + 1 == len(layers) or x.grad_fn is None or x is segment_input:
+            continue
+        if policy.should_cut(Segment(segment_input, x, i + 1 - start)):
+            x.grad_fn = CheckpointBackward(_run_layers(layers[start:i + 1]), [segment_input], rng_state)
+            start, segment_input, rng_state = i + 1, x, get_rng_state()
+
+    return x
@@ -0,0 +1,56 @@
+"""
+In-place weight initializers, filled natively by the counter-based generator
+(see src.rng.manual_seed)
+"""
+import math
+
+def calculate_gain(nonlinearity, param=None):
+    """
+    Recommended scale for the standard deviation after a given nonlinearity
+    """
+    if nonlinearity in ('linear', 'conv2d', 'sigmoid'):
+        return 1.0
+    if nonlinearity == 'tanh':
+        return 5.0 / 3
+    if nonlinearity == 'relu':
+        return math.sqrt(2.0)
+    if nonlinearity == 'leaky_relu':
+        negative_slope = 0.01 if param is None else param
+        return math.sqrt(2.0 / (1 + negative_slope ** 2))
+    raise ValueError("Unsupported nonlinearity '{}'".format(nonlinearity))
+
+def _calculate_fans(tensor):
+    """
+    [out_features, in_features] for Linear, [out_channels, in_channels / groups, kh, kw] for Conv2d
+    """
+    if tensor.ndim < 2:
+        raise ValueError("Fan in and fan out need a tensor with at least 2 dimensions")
+
+    receptive_field = 1
+    for s in tensor.shape[2:]:
+        receptive_field *= s
+    return tensor.shape[1] * receptive_field, tensor.shape[0] * receptive_field
+
+def uniform_(tensor, a=0.0, b=1.0):
+    return tensor.uniform_(a, b)
+
+def normal_(tensor, mean=0.0, std=1.0):
+    return tensor.normal_(mean, std)
+
+def xavier_uniform_(tensor, gain=1.0):
+    fan_in, fan_out = _calculate_fans(tensor)
+    bound = gain * math.sqrt(6.0 / (fan_in + fan_out))
+    return tensor.uniform_(-bound, bound)
+
+def xavier_normal_(tensor, gain=1.0):
+    fan_in, fan_out = _calculate_fans(tensor)
+    return tensor.normal_(0.0, gain * math.sqrt(2.0 / (fan_in + fan_out)))
+
+def kaiming_uniform_(tensor, a=0, mode='fan_in', nonlinearity='leaky_relu'):
+    fan = _calculate_fans(tensor)[0 if mode == 'fan_in' else 1]
+    bound = math.sqrt(3.0) * calculate_gain(nonlinearity, a) / math.sqrt(fan)
+    return tensor.uniform_(-bound, bound)
+
+def kaiming_normal_(tensor, a=0, mode='fan_in', nonlinearity='leaky_relu'):
+    fan = _calculate_fans(tensor)[0 if mode == 'fan_in' else 1]
+    return tensor.normal_(0.0, calculate_gain(nonlinearity, a) / math.sqrt(fan))
@@ -1 +1,5 @@
-from .linear import *
\ No newline at end of file
+from .linear import *
+from .conv import *
+from .pooling import *
+from .dropout import *
+from .container import *
\ No newline at end of file
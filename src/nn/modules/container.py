@@ -0,0 +1,47 @@
+from ..module import Module
+from ..checkpoint import checkpoint_sequential
+
+class Sequential(Module):
+    """
+    Runs modules in order, each on the output of the previous one
+    With a checkpoint policy (nn.EveryKLayers(k) or nn.MemoryBudget(nbytes)) the
+    stack is cut into segments whose activations are recomputed during backward
+    model = nn.Sequential(*blocks, checkpoint=nn.EveryKLayers(4))
+    """
+    def __init__(self, *modules, checkpoint=None):
+        super().__init__()
+        for index, module in enumerate(modules):
+            setattr(self, str(index), module)
+        self.checkpoint = checkpoint
+
+    def forward(self, x):
+        layers = list(self._modules.values())
+        if self.checkpoint is None:
+            for layer in layers:
+                x = layer(x)
+            return x
+
+        return checkpoint_sequential(layers, x, self.checkpoint)
+
+    def parameters(self):
+        # In layer order: Module.parameters sorts by name, which puts '10' before '2'
+        for name, value in self._params.items():
+            yield self, name, value
+        for module in self._modules.values():
+            yield from module.parameters()
+
+    def train(self):
+        super().train()
+        for module in self.modules():
+            module.train()
+
+    def eval(self):
+        super().eval()
+        for module in self.modules():
+            module.eval()
+
+    def __len__(self):
+        return len(self._modules)
+
+    def __getitem__(self, index):
+        return list(self._modules.values())[index]
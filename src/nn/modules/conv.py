@@ -0,0 +1,32 @@
+from ..module import Module
+from ..parameter import Parameter
+from src.utils.utils import pair
+
+class Conv2d(Module):
+    def __init__(self, in_channels, out_channels, kernel_size, stride=1, padding=0, dilation=1, groups=1, bias=True):
+        super().__init__()
+        if in_channels % groups != 0 or out_channels % groups != 0:
+            raise ValueError("in_channels and out_channels must be divisible by groups")
+
+        self.in_channels = in_channels
+        self.out_channels = out_channels
+        self.kernel_size = pair(kernel_size)
+        self.stride = pair(stride)
+        self.padding = pair(padding)
+        self.dilation = pair(dilation)
+        self.groups = groups
+        self.weight = Parameter(shape=[self.out_channels, self.in_channels // groups, *self.kernel_size])
+
+        if bias:
+            self.bias = Parameter(shape=[self.out_channels])
+        else:
+            self.bias = None
+
+    def forward(self, x):
+        return x.conv2d(self.weight, self.bias, self.stride, self.padding, self.dilation, self.groups)
+
+    def inner_repr(self):
+        return f"in_channels={self.in_channels}, out_channels={self.out_channels}, " \
+               f"kernel_size={self.kernel_size}, stride={self.stride}, padding={self.padding}, " \
+               f"dilation={self.dilation}, groups={self.groups}, " \
+               f"bias={True if self.bias is not None else False}"
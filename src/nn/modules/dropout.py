@@ -0,0 +1,20 @@
+from ..module import Module
+
+class Dropout(Module):
+    """
+    Zeroes elements with probability p during training, scaling the rest by 1 / (1 - p)
+    Identity in eval mode
+    """
+    def __init__(self, p=0.5):
+        super().__init__()
+        if p < 0 or p > 1:
+            raise ValueError("Dropout probability must be in [0, 1], got {}".format(p))
+        self.p = p
+
+    def forward(self, x):
+        if not self.training or self.p == 0:
+            return x
+        return x.dropout(self.p)
+
+    def inner_repr(self):
+        return f"p={self.p}"
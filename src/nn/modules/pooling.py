@@ -0,0 +1,28 @@
+from ..module import Module
+from src.utils.utils import pair
+
+class MaxPool2d(Module):
+    def __init__(self, kernel_size, stride=None, padding=0):
+        super().__init__()
+        self.kernel_size = pair(kernel_size)
+        self.stride = pair(stride) if stride is not None else self.kernel_size
+        self.padding = pair(padding)
+
+    def forward(self, x):
+        return x.max_pool2d(self.kernel_size, self.stride, self.padding)
+
+    def inner_repr(self):
+        return f"kernel_size={self.kernel_size}, stride={self.stride}, padding={self.padding}"
+
+class AvgPool2d(Module):
+    def __init__(self, kernel_size, stride=None, padding=0):
+        super().__init__()
+        self.kernel_size = pair(kernel_size)
+        self.stride = pair(stride) if stride is not None else self.kernel_size
+        self.padding = pair(padding)
+
+    def forward(self, x):
+        return x.avg_pool2d(self.kernel_size, self.stride, self.padding)
+
+    def inner_repr(self):
+        return f"kernel_size={self.kernel_size}, stride={self.stride}, padding={self.padding}"
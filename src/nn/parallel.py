@@ -0,0 +1,93 @@
+from .module import Module
+import threading
+import queue
+
+class DistributedDataParallel(Module):
+    """
+    Data-parallel wrapper: every rank runs the same model on its own data and
+    gradients are averaged across the ProcessGroup during backward.
+
+    Parameters are grouped into buckets in reverse registration order. As soon
+    as every gradient in a bucket is ready, the bucket is handed to a
+    communication thread whose all-reduce runs outside the GIL while backward
+    keeps going. Backward returns once all buckets are reduced, so every
+    parameter must receive its gradient exactly once per backward: a parameter
+    reached twice raises during backward, one left without a gradient raises
+    at the next forward. Buckets are launched in the order they
+    become ready, which is identical on every rank because all ranks run the
+    same graph.
+    """
+    def __init__(self, module, process_group, bucket_cap=1 << 18):
+        super().__init__()
+        self.module = module
+        self.process_group = process_group
+        self.bucket_cap = bucket_cap
+
+        params = list(module.parameters())
+        process_group.broadcast([p for _, _, p in params], root=0)
+
+        self._buckets = []
+        bucket, size = [], 0
+        for index in reversed(range(len(params))):
+            numel = params[index][2].numel
+            if bucket and size + numel > bucket_cap:
+                self._buckets.append(bucket)
+                bucket, size = [], 0
+            bucket.append(index)
+            size += numel
+        if bucket:
+            self._buckets.append(bucket)
+
+        for b, bucket in enumerate(self._buckets):
+            for index in bucket:
+                _, _, parameter = params[index]
+                parameter.hooks.append(self._make_hook(b, index))
+
+        self._num_params = len(params)
+        self._queue = queue.Queue()
+        self._done = threading.Semaphore(0)
+        self._reset()
+        threading.Thread(target=self._communicate, daemon=True).start()
+
+    def _reset(self):
+        self._grads = [None] * self._num_params
+        self._pending = [len(bucket) for bucket in self._buckets]
+        self._launched = 0
+
+    def _make_hook(self, b, index):
+        def hook(parameter):
+            grad = parameter.grad
+            if grad.is_sparse:
+                grad = parameter.grad = grad.to_dense()
+            else:
+                # The graph may still read this tensor (AddBackward hands the same
+                # gradient to both inputs), so the comm thread averages a copy
+                grad = parameter.grad = grad * 1.0
+            self._grads[index] = grad
+            self._pending[b] -= 1
+            if self._pending[b] < 0:
+                raise RuntimeError("A parameter in bucket {} received its gradient more than once in one "
+                                   "backward".format(b))
+            if self._pending[b] == 0:
+                self._queue.put([self._grads[i] for i in self._buckets[b]])
+                self._launched += 1
+                if self._launched == len(self._buckets):
+                    for _ in self._buckets:
+                        self._done.acquire()
+                    self._reset()
+        return hook
+
+    def _communicate(self):
+        while True:
+            grads = self._queue.get()
+            self.process_group.allreduce(grads, average=True)
+            self._done.release()
+
+    def forward(self, *inputs, **kwargs):
+        if self._launched != 0:
+            raise RuntimeError("Only {} of {} buckets were reduced in the last backward: some parameter received "
+                               "no gradient".format(self._launched, len(self._buckets)))
+        return self.module(*inputs, **kwargs)
+
+    def inner_repr(self):
+        return f"world_size={self.process_group.world_size}, buckets={len(self._buckets)}"
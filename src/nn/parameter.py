@@ -1,11 +1,15 @@
-from src.tensor import Tensor
-from src.utils import utils
-import random
+from src.tensor import Tensor, TensorHandle
 
 class Parameter(Tensor):
     """
     A parameter is a trainable tensor.
+    Values are drawn from U(-1, 1) natively; see src.nn.init for other schemes.
     """
     def __init__(self, shape):
-        data = utils.generate_random_list(shape=shape)
-        super().__init__(data, requires_grad=True)
\ No newline at end of file
+        super().__init__()
+        self.tensor = TensorHandle.empty(shape)
+        self.shape = list(shape)
+        self.ndim = len(shape)
+        self.numel = self.tensor.size
+        self.requires_grad = True
+        self.uniform_(-1, 1)
@@ -36,11 +36,19 @@ class SGD(Optimizer):
         for i, (module, name, _) in enumerate(self.parameters):
             parameter = getattr(module, name)
 
+            if parameter.grad.is_sparse:
+                if self.momentum == 0:
+                    # Update only the rows/columns the sparse gradient touches
+                    parameter.grad.add_to_(parameter, -self.lr)
+                    continue
+                parameter.grad = parameter.grad.to_dense()
+
             velocity = self._cache['velocity'][i]
 
             velocity = self.momentum * velocity - self.lr * parameter.grad
 
-            updated_parameter = parameter + velocity
+            # A leaf again, so its own hooks run and it receives its own gradient
+            updated_parameter = (parameter + velocity).detach()
             updated_parameter.hooks = parameter.hooks.copy()
 
             setattr(module, name, updated_parameter)
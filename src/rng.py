@@ -0,0 +1,23 @@
+from . import _backend
+
+def manual_seed(seed):
+    """
+    Seed the global generator used by uniform_, normal_, nn.init and dropout
+
+    Values are drawn from a counter-based (Philox) stream, so a given seed
+    reproduces the same tensors whatever the number of threads
+    """
+    _backend.manual_seed(seed)
+
+def initial_seed():
+    return _backend.initial_seed()
+
+def get_rng_state():
+    """
+    (seed, offset) of the global generator; passing it to set_rng_state replays
+    the same values, e.g. to recompute dropout masks
+    """
+    return _backend.get_rng_state()
+
+def set_rng_state(state):
+    _backend.set_rng_state(*state)
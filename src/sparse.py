@@ -0,0 +1,192 @@
+import ctypes
+from .tensor import Tensor, TensorHandle, CTensor
+from .autograd.functions import *
+
+class CSparseTensor(ctypes.Structure):
+    _fields_ = [
+        ('values', ctypes.POINTER(ctypes.c_float)),
+        ('col_indices', ctypes.POINTER(ctypes.c_int)),
+        ('row_ptr', ctypes.POINTER(ctypes.c_int)),
+        ('rows', ctypes.c_int),
+        ('cols', ctypes.c_int),
+        ('nnz', ctypes.c_int),
+    ]
+
+# Signatures are declared once at import, not on every call (SpMM runs every step)
+_C = Tensor._C
+_C.create_sparse_tensor_coo.argtypes = [ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int),
+                                        ctypes.POINTER(ctypes.c_float), ctypes.c_int,
+                                        ctypes.c_int, ctypes.c_int]
+_C.create_sparse_tensor_coo.restype = ctypes.POINTER(CSparseTensor)
+
+_C.sparse_from_dense_tensor.argtypes = [ctypes.POINTER(CTensor)]
+_C.sparse_from_dense_tensor.restype = ctypes.POINTER(CSparseTensor)
+
+_C.sparse_to_dense_tensor.argtypes = [ctypes.POINTER(CSparseTensor)]
+_C.sparse_to_dense_tensor.restype = ctypes.c_void_p
+
+_C.add_sparse_tensor.argtypes = [ctypes.POINTER(CSparseTensor), ctypes.POINTER(CSparseTensor)]
+_C.add_sparse_tensor.restype = ctypes.POINTER(CSparseTensor)
+
+_C.sparse_axpy_tensor.argtypes = [ctypes.POINTER(CSparseTensor), ctypes.c_float, ctypes.POINTER(CTensor)]
+_C.sparse_axpy_tensor.restype = None
+
+_C.spmm_tensor.argtypes = [ctypes.POINTER(CSparseTensor), ctypes.POINTER(CTensor)]
+_C.spmm_tensor.restype = ctypes.c_void_p
+
+_C.dense_spmm_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(CSparseTensor)]
+_C.dense_spmm_tensor.restype = ctypes.c_void_p
+
+_C.spmm_transpose_tensor.argtypes = [ctypes.POINTER(CSparseTensor), ctypes.POINTER(CTensor)]
+_C.spmm_transpose_tensor.restype = ctypes.POINTER(CSparseTensor)
+
+_C.dense_spmm_transpose_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(CSparseTensor)]
+_C.dense_spmm_transpose_tensor.restype = ctypes.POINTER(CSparseTensor)
+
+_C.free_sparse_tensor.argtypes = [ctypes.POINTER(CSparseTensor)]
+_C.free_sparse_tensor.restype = None
+
+class SparseTensor:
+    """
+    2D sparse tensor stored in CSR form. Memory and matmul FLOPs scale with
+    the number of non-zeros rather than with rows * cols.
+
+    Example:
+        s = SparseTensor([[0, 1, 1], [2, 0, 2]], [3., 4., 5.], [2, 3])  # COO (rows, cols)
+        s = SparseTensor.from_dense(tensor)
+        y = s @ dense           # sparse x dense
+        y = dense @ s           # dense x sparse
+    """
+    is_sparse = True
+    _C = Tensor._C
+
+    def __init__(self, indices=None, values=None, shape=None):
+        self.grad = None
+        self.grad_fn = None
+        self.requires_grad = False
+
+        if indices is None:
+            self.tensor = None
+            self.shape = None
+            return
+
+        rows, cols = indices
+        if len(rows) != len(cols) or len(rows) != len(values):
+            raise ValueError("COO row indices, column indices and values must have the same length")
+
+        nnz = len(values)
+        row_ctype = (ctypes.c_int * nnz)(*rows)
+        col_ctype = (ctypes.c_int * nnz)(*cols)
+        values_ctype = (ctypes.c_float * nnz)(*values)
+
+        self.tensor = SparseTensor._C.create_sparse_tensor_coo(row_ctype, col_ctype, values_ctype, nnz, shape[0], shape[1])
+        if not self.tensor:
+            raise ValueError("Invalid COO data for a sparse tensor of shape {}".format(shape))
+        self.shape = list(shape)
+
+    @staticmethod
+    def _wrap(result_tensor_ptr, shape):
+        result_data = SparseTensor()
+        result_data.tensor = result_tensor_ptr
+        result_data.shape = list(shape)
+        return result_data
+
+    @staticmethod
+    def from_dense(tensor):
+        if tensor.ndim != 2:
+            raise ValueError("Only 2D tensors can be converted to sparse")
+
+        return SparseTensor._wrap(SparseTensor._C.sparse_from_dense_tensor(tensor.tensor), tensor.shape)
+
+    @property
+    def nnz(self):
+        return self.tensor.contents.nnz
+
+    @property
+    def ndim(self):
+        return 2
+
+    def to_dense(self):
+        result_data = Tensor()
+        result_data.tensor = TensorHandle.from_address(SparseTensor._C.sparse_to_dense_tensor(self.tensor))
+        result_data.shape = self.shape.copy()
+        result_data.ndim = 2
+        result_data.numel = self.shape[0] * self.shape[1]
+
+        return result_data
+
+    def __add__(self, other):
+        if getattr(other, 'is_sparse', False):
+            if self.shape != other.shape:
+                raise ValueError("Sparse tensors must have the same shape for addition")
+
+            return SparseTensor._wrap(SparseTensor._C.add_sparse_tensor(self.tensor, other.tensor), self.shape)
+
+        # sparse + dense is dense; accumulate the stored entries into a copy
+        result_data = other + other.zeros_like()
+        self.add_to_(result_data)
+        return result_data
+
+    def __radd__(self, other):
+        return self.__add__(other)
+
+    def add_to_(self, dense, alpha=1.0):
+        """
+        In-place dense += alpha * self, touching only the stored entries
+        """
+        if self.shape != dense.shape:
+            raise ValueError("Sparse update shape {} does not match tensor shape {}".format(self.shape, dense.shape))
+
+        SparseTensor._C.sparse_axpy_tensor(self.tensor, ctypes.c_float(alpha), dense.tensor)
+        return dense
+
+    def __matmul__(self, other):
+        if other.ndim != 2 or self.shape[1] != other.shape[0]:
+            raise ValueError("Incompatible shapes for sparse matrix multiplication")
+
+        result_data = Tensor()
+        result_data.tensor = TensorHandle.from_address(SparseTensor._C.spmm_tensor(self.tensor, other.tensor))
+        result_data.shape = [self.shape[0], other.shape[1]]
+        result_data.ndim = 2
+        result_data.numel = self.shape[0] * other.shape[1]
+
+        result_data.requires_grad = other.requires_grad
+        if result_data.requires_grad:
+            result_data.grad_fn = SparseMatmulBackward(self, other)
+
+        return result_data
+
+    def __rmatmul__(self, other):
+        if other.ndim != 2 or other.shape[1] != self.shape[0]:
+            raise ValueError("Incompatible shapes for sparse matrix multiplication")
+
+        result_data = Tensor()
+        result_data.tensor = TensorHandle.from_address(SparseTensor._C.dense_spmm_tensor(other.tensor, self.tensor))
+        result_data.shape = [other.shape[0], self.shape[1]]
+        result_data.ndim = 2
+        result_data.numel = other.shape[0] * self.shape[1]
+
+        result_data.requires_grad = other.requires_grad
+        if result_data.requires_grad:
+            result_data.grad_fn = DenseSparseMatmulBackward(other, self)
+
+        return result_data
+
+    def t_matmul(self, other):
+        """
+        self^T @ other as a row-sparse tensor: only columns of self holding entries produce rows
+        """
+        return SparseTensor._wrap(SparseTensor._C.spmm_transpose_tensor(self.tensor, other.tensor),
+                                  [self.shape[1], other.shape[1]])
+
+    def rmatmul_t(self, other):
+        """
+        other @ self^T as a column-sparse tensor: only rows of self holding entries produce columns
+        """
+        return SparseTensor._wrap(SparseTensor._C.dense_spmm_transpose_tensor(other.tensor, self.tensor),
+                                  [other.shape[0], self.shape[0]])
+
+    def __del__(self):
+        if self.tensor:
+            SparseTensor._C.free_sparse_tensor(self.tensor)
+            self.tensor = None
@@ -0,0 +1,38 @@
+from contextlib import contextmanager
+from . import _backend
+
+def set_async(enabled):
+    """
+    Queue backend ops on the execution stream instead of running them inline
+
+    Ops then return at once and run in order on a worker thread, overlapping
+    the Python around them. Reading values (item, tolist, numpy) waits for
+    the ops they depend on; an op that fails is reported by the next
+    synchronize(). Turning async execution off synchronizes first
+    """
+    _backend.set_async(enabled)
+
+def is_async():
+    return _backend.is_async()
+
+def synchronize():
+    """
+    Wait for every queued op, raising the first error one of them hit
+    """
+    _backend.synchronize()
+
+@contextmanager
+def async_execution(enabled=True):
+    """
+    with async_execution():
+        for x, y in batches:
+            ...
+    Restores the previous mode on exit, which waits for the queued ops
+    """
+    previous = is_async()
+    set_async(enabled)
+    try:
+        yield
+    finally:
+        set_async(previous)
+        synchronize()
@@ -1,17 +1,37 @@
 import ctypes
+import operator
 import os
 from .autograd.functions import *
+from .utils.utils import pair
+from . import _backend
 
 class CTensor(ctypes.Structure):
     _fields_ = [
         ('data', ctypes.POINTER(ctypes.c_float)),
-        ('strides', ctypes.POINTER(ctypes.c_int)),
         ('shape', ctypes.POINTER(ctypes.c_int)),
+        ('strides', ctypes.POINTER(ctypes.c_int)),
         ('ndim', ctypes.c_int),
         ('size', ctypes.c_int),
+        ('device', ctypes.c_char_p),
     ]
 
+class TensorHandle(_backend.TensorHandle):
+    """
+    Owning handle to a backend tensor; ops are native methods (see backend/binding.cpp).
+    It can also be passed wherever a ctypes entry point expects POINTER(CTensor)
+    """
+    __slots__ = ()
+
+    @property
+    def _as_parameter_(self):
+        return ctypes.cast(self.address, ctypes.POINTER(CTensor))
+
+    @property
+    def contents(self):
+        return self._as_parameter_.contents
+
 class Tensor:
+    is_sparse = False
     module_dir = os.path.dirname(os.path.abspath(__file__))
     _C = ctypes.CDLL(os.path.join(module_dir, "tensor_lib.so"))
 
@@ -24,10 +44,6 @@ class Tensor:
             data, shape = self.flatten(data)
             
             self.shape = shape.copy()
-            
-            self._data_ctype = (ctypes.c_float * len(data))(*data.copy())
-            self._shape_ctype = (ctypes.c_int * len(shape))(*shape.copy())
-            self._ndim_ctype = ctypes.c_int(len(shape))
             #self._device_ctype = device.encode('utf-8')
 
             self.ndim = len(shape)
@@ -42,14 +58,7 @@ class Tensor:
             self.grad = None
             self.grad_fn = None
 
-            Tensor._C.create_tensor.argtypes = [ctypes.POINTER(ctypes.c_float), ctypes.POINTER(ctypes.c_int), ctypes.c_int]
-            Tensor._C.create_tensor.restype = ctypes.POINTER(CTensor)
-            
-            self.tensor = Tensor._C.create_tensor(
-                self._data_ctype,
-                self._shape_ctype,
-                self._ndim_ctype
-            )
+            self.tensor = TensorHandle(data, shape)
         
         else:
             self.tensor = None,
@@ -91,37 +100,169 @@ class Tensor:
     def __getitem__(self, indices):
         """
         Access tensor by index tensor[i, j, k...]
+        Slices and partial indexing return a tensor: tensor[2:10:2], tensor[:, 0], tensor[..., 1:]
+        The result shares the data when the selection is contiguous (e.g. a range of rows)
+        Indexing with a tensor of row indices is index_select(0, index): tensor[perm]
         """
+        if isinstance(indices, Tensor):
+            return self.index_select(0, indices)
+
+        if isinstance(indices, list) or (isinstance(indices, int) and self.ndim == 1) or \
+                (isinstance(indices, tuple) and len(indices) == self.ndim and
+                 all(isinstance(i, int) for i in indices)):
+            return self.tensor.item(indices)
+
+        return self._slice(indices if isinstance(indices, tuple) else (indices,))
+
+    def _slice(self, indices):
+        ellipsis = sum(1 for i in indices if i is Ellipsis)
+        if ellipsis > 1:
+            raise IndexError("an index can only have a single ellipsis")
+        if ellipsis:
+            at = next(d for d, i in enumerate(indices) if i is Ellipsis)
+            fill = (slice(None),) * (self.ndim - len(indices) + 1)
+            indices = indices[:at] + fill + indices[at + 1:]
+        if len(indices) > self.ndim:
+            raise IndexError("too many indices for a {}D tensor".format(self.ndim))
+        indices = indices + (slice(None),) * (self.ndim - len(indices))
+
+        start, step, shape, kept = [], [], [], []
+        for d, index in enumerate(indices):
+            if isinstance(index, slice):
+                first, stop, stride = index.indices(self.shape[d])
+                if stride <= 0:
+                    raise ValueError("slice step must be positive")
+                start.append(first)
+                step.append(stride)
+                shape.append(len(range(first, stop, stride)))
+                kept.append(shape[-1])
+            else:
+                i = operator.index(index)
+                if i < -self.shape[d] or i >= self.shape[d]:
+                    raise IndexError("index {} is out of bounds for dimension {} with size {}".format(
+                        i, d, self.shape[d]))
+                start.append(i % self.shape[d])
+                step.append(1)
+                shape.append(1)
+
+        # Integer indices drop their dimension
+        kept = kept or [1]
+        result_tensor = self.tensor.slice(start, step, shape, kept)
 
-        if isinstance(indices, int):
-            indices = [indices]
-        if len(indices) != self.ndim:
-            raise ValueError("Number of indices must match the number of dimensions")
-        
-        Tensor._C.get_element.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(ctypes.c_int)]
-        Tensor._C.get_element.restype = ctypes.c_float
-                                       
-        indices = (ctypes.c_int * len(indices))(*indices)
-        value = Tensor._C.get_element(self.tensor, indices)  
-        
-        return value
+        result_data = Tensor()
+        result_data.tensor = result_tensor
+        result_data.shape = kept
+        result_data.ndim = len(kept)
+        result_data.numel = 1
+        for s in kept:
+            result_data.numel *= s
+
+        result_data.requires_grad = self.requires_grad
+        if result_data.requires_grad:
+            result_data.grad_fn = SliceBackward(self, start, step, shape)
+
+        return result_data
+
+    def slice_grad(self, input, start, step, shape):
+        """
+        Gradient of a slice w.r.t. its input, given self as the output gradient
+        """
+        result_data = Tensor()
+        result_data.tensor = self.tensor.view(shape).slice_backward(start, step, input.shape)
+        result_data.shape = input.shape.copy()
+        result_data.ndim = input.ndim
+        result_data.numel = input.numel
+
+        return result_data
+
+    def _index_result(self, result_tensor, shape):
+        # The shape is worked out here rather than read from the handle, which
+        # would wait for a queued op (see src.stream)
+        result_data = Tensor()
+        result_data.tensor = result_tensor
+        result_data.shape = list(shape)
+        result_data.ndim = len(shape)
+        result_data.numel = 1
+        for s in shape:
+            result_data.numel *= s
+
+        return result_data
+
+    def index_select(self, dim, index):
+        """
+        Rows (or slices along dim) picked by a 1D index: a list, range, int array or Tensor
+        result.shape[dim] == len(index); repeated indices are allowed
+        batch = x.index_select(0, permutation[i:i + batch_size])
+        """
+        dim = dim + self.ndim if dim < 0 else dim
+        index = index.tensor if isinstance(index, Tensor) else index
+
+        shape = self.shape.copy()
+        shape[dim] = index.size if isinstance(index, TensorHandle) else len(index)
+        result_data = self._index_result(self.tensor.index_select(dim, index), shape)
+
+        result_data.requires_grad = self.requires_grad
+        if result_data.requires_grad:
+            result_data.grad_fn = IndexSelectBackward(self, dim, index)
+
+        return result_data
+
+    def gather(self, dim, index):
+        """
+        result[i][j][k] = self[i][index[i][j][k]][k] for dim == 1, and likewise for other dims
+        index has the shape of the result and matches self in every dimension but dim
+        """
+        dim = dim + self.ndim if dim < 0 else dim
+        index = index if isinstance(index, Tensor) else Tensor(index)
+
+        result_data = self._index_result(self.tensor.gather(dim, index.tensor), index.shape)
+
+        result_data.requires_grad = self.requires_grad
+        if result_data.requires_grad:
+            result_data.grad_fn = GatherBackward(self, dim, index)
+
+        return result_data
+
+    def scatter_add(self, dim, index, src):
+        """
+        Out of place: result = self, then result[i][index[i][j][k]][k] += src[i][j][k] for dim == 1
+        index has the shape of src; repeated indices accumulate
+        """
+        dim = dim + self.ndim if dim < 0 else dim
+        index = index if isinstance(index, Tensor) else Tensor(index)
+
+        result_data = self._index_result(self.tensor.scatter_add(dim, index.tensor, src.tensor), self.shape)
+
+        result_data.requires_grad = self.requires_grad or src.requires_grad
+        if result_data.requires_grad:
+            result_data.grad_fn = ScatterAddBackward(self, dim, index, src)
+
+        return result_data
+
+    def index_grad(self, input, mode, dim, index):
+        """
+        Gradient of index_select ('select') or gather ('gather') w.r.t. input, given self as the
+        output gradient: the gradient rows are added back where they were read from
+        """
+        if mode == 'select':
+            result_tensor = self.tensor.index_select_backward(dim, index, input.shape[dim])
+        else:
+            result_tensor = self.tensor.gather_backward(dim, index.tensor, input.shape[dim])
+
+        return self._index_result(result_tensor, input.shape)
 
     def reshape(self, new_shape):
         """
         Reshape tensor
         result = tensor.reshape([1,2])
         """
-        new_shape_ctype = (ctypes.c_int * len(new_shape))(*new_shape)
-        new_ndim_ctype = ctypes.c_int(len(new_shape))
-        
-        Tensor._C.reshape_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(ctypes.c_int), ctypes.c_int]
-        Tensor._C.reshape_tensor.restype = ctypes.POINTER(CTensor)
-        result_tensor_ptr = Tensor._C.reshape_tensor(self.tensor, new_shape_ctype, new_ndim_ctype)   
+        result_tensor = self.tensor.reshape(new_shape)
 
-        result_data = Tensor(new_shape)
-        result_data.tensor = result_tensor_ptr
+        result_data = Tensor()
+        result_data.tensor = result_tensor
         result_data.shape = new_shape.copy()
         result_data.ndim = len(new_shape)
+        result_data.numel = self.numel
 
         return result_data
 
@@ -130,19 +271,19 @@ class Tensor:
         Add tensors
         result = tensor1 + tensor2
         """
+        if other.is_sparse:
+            return other + self
       
         if self.shape != other.shape:
             raise ValueError("Tensors must have the same shape for addition")
         
-        Tensor._C.add_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(CTensor)]
-        Tensor._C.add_tensor.restype = ctypes.POINTER(CTensor)
+        result_tensor = self.tensor.add(other.tensor)
 
-        result_tensor_ptr = Tensor._C.add_tensor(self.tensor, other.tensor)
-
-        result_data = Tensor(self.shape)
-        result_data.tensor = result_tensor_ptr
+        result_data = Tensor()
+        result_data.tensor = result_tensor
         result_data.shape = self.shape.copy()
         result_data.ndim = self.ndim
+        result_data.numel = self.numel
 
         result_data.requires_grad = self.requires_grad or other.requires_grad
         if result_data.requires_grad:
@@ -172,11 +313,15 @@ class Tensor:
             else:
                 tensor.grad += grad
 
+            if tensor.grad_fn is None:
+                for hook in tensor.hooks:
+                    hook(tensor)
+
             # Propagate gradients to inputs if not a leaf tensor
             if tensor.grad_fn is not None:
                 grads = tensor.grad_fn.backward(grad)
                 for tensor, grad in zip(tensor.grad_fn.input, grads):
-                    if isinstance(tensor, Tensor) and tensor not in visited:
+                    if isinstance(tensor, Tensor) and grad is not None and tensor not in visited:
                         stack.append((tensor, grad))
                         visited.add(tensor)
 
@@ -184,15 +329,10 @@ class Tensor:
         self.grad = None
 
     def ones_like(self):
-        
-        Tensor._C.ones_like_tensor.argtypes = [ctypes.POINTER(CTensor)]
-        Tensor._C.ones_like_tensor.restype = ctypes.POINTER(CTensor)
-        Tensor._C.ones_like_tensor(self.tensor)   
-
-        result_tensor_ptr = Tensor._C.ones_like_tensor(self.tensor)
+        result_tensor = self.tensor.ones_like()
 
         result_data = Tensor()
-        result_data.tensor = result_tensor_ptr
+        result_data.tensor = result_tensor
         result_data.shape = self.shape.copy()
         result_data.ndim = self.ndim
         result_data.numel = self.numel
@@ -200,32 +340,77 @@ class Tensor:
         return result_data
     
     def zeros_like(self):
-        
-        Tensor._C.zeros_like_tensor.argtypes = [ctypes.POINTER(CTensor)]
-        Tensor._C.zeros_like_tensor.restype = ctypes.POINTER(CTensor)
-        Tensor._C.zeros_like_tensor(self.tensor)   
-
-        result_tensor_ptr = Tensor._C.zeros_like_tensor(self.tensor)
+        result_tensor = self.tensor.zeros_like()
 
         result_data = Tensor()
-        result_data.tensor = result_tensor_ptr
+        result_data.tensor = result_tensor
         result_data.shape = self.shape.copy()
         result_data.ndim = self.ndim
         result_data.numel = self.numel
 
         return result_data
     
+    @staticmethod
+    def empty(shape, requires_grad=False):
+        """
+        Uninitialized tensor, e.g. to be filled in place by uniform_/normal_
+        """
+        result_data = Tensor()
+        result_data.tensor = TensorHandle.empty(shape)
+        result_data.shape = list(shape)
+        result_data.ndim = len(shape)
+        result_data.numel = 1
+        for s in shape:
+            result_data.numel *= s
+        result_data.requires_grad = requires_grad
+
+        return result_data
+
+    def uniform_(self, low=0.0, high=1.0):
+        """
+        In place: fill from U(low, high) with the global counter-based generator (see src.rng)
+        """
+        self.tensor.uniform_(low, high)
+        return self
+
+    def normal_(self, mean=0.0, std=1.0):
+        """
+        In place: fill from N(mean, std^2) with the global counter-based generator
+        """
+        self.tensor.normal_(mean, std)
+        return self
+
+    def dropout(self, p=0.5):
+        """
+        Zero each element with probability p and scale the rest by 1 / (1 - p)
+        The mask is generated inside the kernel and regenerated for the backward pass
+        """
+        seed, offset = _backend.random_reserve(self.numel)
+        result_data = self._dropout(p, seed, offset)
+
+        result_data.requires_grad = self.requires_grad
+        if result_data.requires_grad:
+            result_data.grad_fn = DropoutBackward(self, p, seed, offset)
+
+        return result_data
+
+    def _dropout(self, p, seed, offset):
+        result_data = Tensor()
+        result_data.tensor = self.tensor.dropout(p, seed, offset)
+        result_data.shape = self.shape.copy()
+        result_data.ndim = self.ndim
+        result_data.numel = self.numel
+
+        return result_data
+
     def __sub__(self, other):
         if isinstance(other, (int, float)):
             other = other * self.ones_like()
 
-        Tensor._C.sub_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(CTensor)]
-        Tensor._C.sub_tensor.restype = ctypes.POINTER(CTensor)
-
-        result_tensor_ptr = Tensor._C.sub_tensor(self.tensor, other.tensor)
+        result_tensor = self.tensor.sub(other.tensor)
 
         result_data = Tensor()
-        result_data.tensor = result_tensor_ptr
+        result_data.tensor = result_tensor
         result_data.shape = self.shape.copy()
         result_data.ndim = self.ndim
 
@@ -245,10 +430,7 @@ class Tensor:
             result_data.ndim = self.ndim
             result_data.numel = self.numel
 
-            Tensor._C.scalar_mul_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.c_float]
-            Tensor._C.scalar_mul_tensor.restype = ctypes.POINTER(CTensor)
-
-            result_data.tensor = Tensor._C.scalar_mul_tensor(self.tensor, ctypes.c_float(other))
+            result_data.tensor = self.tensor.scalar_mul(other)
 
             result_data.requires_grad = self.requires_grad
             if result_data.requires_grad:
@@ -259,13 +441,10 @@ class Tensor:
             if self.shape != other.shape:
                 raise ValueError("Tensors must have the same shape for element-wise multiplication")
 
-            Tensor._C.elementwise_mul_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(CTensor)]
-            Tensor._C.elementwise_mul_tensor.restype = ctypes.POINTER(CTensor)
-
-            result_tensor_ptr = Tensor._C.elementwise_mul_tensor(self.tensor, other.tensor)
+            result_tensor = self.tensor.mul(other.tensor)
 
             result_data = Tensor()
-            result_data.tensor = result_tensor_ptr
+            result_data.tensor = result_tensor
             result_data.shape = self.shape.copy()
             result_data.ndim = self.ndim
             result_data.numel = self.numel
@@ -282,13 +461,11 @@ class Tensor:
         return self.__mul__(other)
     
     def log(self):
-        Tensor._C.log_tensor.argtypes = [ctypes.POINTER(CTensor)]
-        Tensor._C.log_tensor.restype = ctypes.POINTER(CTensor)
 
-        result_tensor_ptr = Tensor._C.log_tensor(self.tensor)
+        result_tensor = self.tensor.log()
 
         result_data = Tensor()
-        result_data.tensor = result_tensor_ptr
+        result_data.tensor = result_tensor
         result_data.shape = self.shape.copy()
         result_data.ndim = self.ndim
         result_data.numel = self.numel
@@ -304,74 +481,73 @@ class Tensor:
         return self.__mul__(-1)
     
     def __matmul__(self, other):
-        if self.ndim < 3 and other.ndim == 3:
-            #broadcasted 2D x 3D matmul
+        if other.is_sparse:
+            return NotImplemented
 
-            Tensor._C.matmul_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(CTensor)]
-            Tensor._C.matmul_tensor.restype = ctypes.POINTER(CTensor)
-            
-            result_tensor_ptr = Tensor._C.matmul_tensor(self.tensor, other.tensor)
+        return self.matmul(other)
 
-            result_data = Tensor()
-            result_data.tensor = result_tensor_ptr
-            result_data.shape = [other.shape[0], self.shape[0], other.shape[2]]
-            result_data.ndim = 3
-            result_data.numel = 1
-            for s in result_data.shape:
-                result_data.numel *= s
-
-
-        elif self.ndim == 3 and other.ndim == 3:
-            #broadcasted 3D x 3D matmul
+    def _matmul_shape(self, other, transpose_a, transpose_b):
+        if self.ndim < 2 or other.ndim < 2:
+            raise ValueError("Matrix multiplication requires at least 2D tensors")
 
-            Tensor._C.matmul_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(CTensor)]
-            Tensor._C.matmul_tensor.restype = ctypes.POINTER(CTensor)
-            
-            result_tensor_ptr = Tensor._C.matmul_tensor(self.tensor, other.tensor)
+        m, k = self.shape[-2:][::-1] if transpose_a else self.shape[-2:]
+        k2, n = other.shape[-2:][::-1] if transpose_b else other.shape[-2:]
+        if k != k2:
+            raise ValueError("Incompatible shapes for matrix multiplication")
 
-            result_data = Tensor()
-            result_data.tensor = result_tensor_ptr
-            result_data.shape = [other.shape[0], self.shape[1], other.shape[2]]
-            result_data.ndim = 3
-            result_data.numel = 1
-            for s in result_data.shape:
-                result_data.numel *= s
-        else:
-            #2D matmul
-            if self.ndim != 2 or other.ndim != 2:
-                raise ValueError("Matrix multiplication requires 2D tensors")
+        batch_a, batch_b = 1, 1
+        for s in self.shape[:-2]:
+            batch_a *= s
+        for s in other.shape[:-2]:
+            batch_b *= s
+        if batch_a != batch_b and batch_a != 1 and batch_b != 1:
+            raise ValueError("Matrix multiplication batch dimensions cannot be broadcast")
 
-            if self.shape[1] != other.shape[0]:
-                raise ValueError("Incompatible shapes for matrix multiplication")
+        if batch_a > batch_b or (batch_a == batch_b and self.ndim >= other.ndim):
+            return self.shape[:-2] + [m, n]
+        return other.shape[:-2] + [m, n]
 
-            Tensor._C.matmul_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(CTensor)]
-            Tensor._C.matmul_tensor.restype = ctypes.POINTER(CTensor)
+    def matmul(self, other, transpose_a=False, transpose_b=False):
+        """
+        Batched matrix product over the last two dims, broadcasting a 2D (or batch 1) operand
+        transpose_a/transpose_b read an operand transposed in place, without a copy
+        result = x.matmul(y, transpose_b=True)  # x @ y^T
+        """
+        shape = self._matmul_shape(other, transpose_a, transpose_b)
 
-            result_tensor_ptr = Tensor._C.matmul_tensor(self.tensor, other.tensor)
+        result_tensor = self.tensor.matmul(other.tensor, transpose_a, transpose_b)
 
-            result_data = Tensor()
-            result_data.tensor = result_tensor_ptr
-            result_data.shape = [self.shape[0], other.shape[1]]
-            result_data.ndim = 2
-            result_data.numel = 1
-            for s in result_data.shape:
-                result_data.numel *= s
+        result_data = Tensor()
+        result_data.tensor = result_tensor
+        result_data.shape = shape
+        result_data.ndim = len(shape)
+        result_data.numel = 1
+        for s in result_data.shape:
+            result_data.numel *= s
 
         result_data.requires_grad = self.requires_grad or other.requires_grad
         if result_data.requires_grad:
-            result_data.grad_fn = MatmulBackward(self, other)
+            result_data.grad_fn = MatmulBackward(self, other, transpose_a, transpose_b)
 
         return result_data
-    
+
+    def matmul_accumulate_(self, a, b, alpha=1.0, beta=1.0, transpose_a=False, transpose_b=False):
+        """
+        In place: self = alpha * op(a) @ op(b) + beta * self
+        When self is a single matrix and the product is batched, the batch is summed into self
+        """
+
+        self.tensor.matmul_accumulate(a.tensor, b.tensor, transpose_a, transpose_b, alpha, beta)
+
+        return self
+
     def __pow__(self, other):
         other = float(other)
-        Tensor._C.tensor_pow_scalar.argtypes = [ctypes.POINTER(CTensor), ctypes.c_float]
-        Tensor._C.tensor_pow_scalar.restype = ctypes.POINTER(CTensor)
 
-        result_tensor_ptr = Tensor._C.tensor_pow_scalar(self.tensor, ctypes.c_float(other))
+        result_tensor = self.tensor.pow_scalar(other)
 
         result_data = Tensor()
-        result_data.tensor = result_tensor_ptr
+        result_data.tensor = result_tensor
         result_data.shape = self.shape.copy()
         result_data.ndim = self.ndim
         result_data.numel = self.numel
@@ -383,13 +559,11 @@ class Tensor:
         return result_data
     
     def sigmoid(self):
-        Tensor._C.sigmoid_tensor.argtypes = [ctypes.POINTER(CTensor)]
-        Tensor._C.sigmoid_tensor.restype = ctypes.POINTER(CTensor)
 
-        result_tensor_ptr = Tensor._C.sigmoid_tensor(self.tensor)
+        result_tensor = self.tensor.sigmoid()
 
         result_data = Tensor()
-        result_data.tensor = result_tensor_ptr
+        result_data.tensor = result_tensor
         result_data.shape = self.shape.copy()
         result_data.ndim = self.ndim
         result_data.numel = self.numel
@@ -410,13 +584,10 @@ class Tensor:
         if axis > self.ndim - 1:
             raise ValueError(f"Error: axis argument {axis} cannot be higher than tensor dimension {self.ndim}")
 
-        Tensor._C.sum_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.c_int, ctypes.c_bool]
-        Tensor._C.sum_tensor.restype = ctypes.POINTER(CTensor)
-
-        result_tensor_ptr = Tensor._C.sum_tensor(self.tensor, axis, keepdim)
+        result_tensor = self.tensor.sum(axis, keepdim)
 
         result_data = Tensor()
-        result_data.tensor = result_tensor_ptr
+        result_data.tensor = result_tensor
 
         if axis == -1:
             if keepdim:
@@ -446,13 +617,11 @@ class Tensor:
     def __truediv__(self, other):
         if isinstance(other, (int, float)):
             other = float(other)
-            Tensor._C.tensor_div_scalar.argtypes = [ctypes.POINTER(CTensor), ctypes.c_float]
-            Tensor._C.tensor_div_scalar.restype = ctypes.POINTER(CTensor)
 
-            result_tensor_ptr = Tensor._C.tensor_div_scalar(self.tensor, ctypes.c_float(other))
+            result_tensor = self.tensor.div_scalar(other)
 
             result_data = Tensor()
-            result_data.tensor = result_tensor_ptr
+            result_data.tensor = result_tensor
             result_data.shape = self.shape.copy()
             result_data.ndim = self.ndim
             result_data.numel = self.numel
@@ -463,15 +632,13 @@ class Tensor:
         
         elif isinstance(self, Tensor) and isinstance(other, Tensor):
             if other.numel == 1:
-                return self.__truediv__(other.tensor.contents.data[0])
+                return self.__truediv__(other.tensor.item([0] * other.ndim))
             
-            Tensor._C.tensor_div_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(CTensor)]
-            Tensor._C.tensor_div_tensor.restype = ctypes.POINTER(CTensor)
 
-            result_tensor_ptr = Tensor._C.tensor_div_tensor(self.tensor, other.tensor)
+            result_tensor = self.tensor.div(other.tensor)
 
             result_data = Tensor()
-            result_data.tensor = result_tensor_ptr
+            result_data.tensor = result_tensor
             result_data.shape = self.shape.copy()
             result_data.ndim = self.ndim
             result_data.numel = self.numel
@@ -489,13 +656,11 @@ class Tensor:
         if self.shape != other.shape:
             raise ValueError("Tensors must have the same shape for subtraction")
         
-        Tensor._C.sub_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.POINTER(CTensor)]
-        Tensor._C.sub_tensor.restype = ctypes.POINTER(CTensor)
 
-        result_tensor_ptr = Tensor._C.sub_tensor(other.tensor, self.tensor)
+        result_tensor = other.tensor.sub(self.tensor)
 
         result_data = Tensor()
-        result_data.tensor = result_tensor_ptr
+        result_data.tensor = result_tensor
         result_data.shape = self.shape.copy()
         result_data.ndim = self.ndim
         result_data.numel = self.numel
@@ -512,13 +677,10 @@ class Tensor:
         if axis2 < 0:
             axis2 = self.ndim + axis2
 
-        Tensor._C.transpose_axes_tensor.argtypes = [ctypes.POINTER(CTensor), ctypes.c_int, ctypes.c_int]
-        Tensor._C.transpose_axes_tensor.restype = ctypes.POINTER(CTensor)
-
-        result_tensor_ptr = Tensor._C.transpose_axes_tensor(self.tensor, axis1, axis2)
+        result_tensor = self.tensor.transpose(axis1, axis2)
 
         result_data = Tensor()
-        result_data.tensor = result_tensor_ptr
+        result_data.tensor = result_tensor
         result_data.shape = self.shape.copy()
         result_data.shape[axis1] = self.shape[axis2]
         result_data.shape[axis2] = self.shape[axis1]
@@ -531,15 +693,38 @@ class Tensor:
 
         return result_data
     
+    def permute(self, *dims):
+        """
+        Reorder dimensions: result.shape[i] == self.shape[dims[i]]
+        result = tensor.permute(0, 2, 3, 1)
+        """
+        if len(dims) == 1 and isinstance(dims[0], (list, tuple)):
+            dims = dims[0]
+        dims = [d + self.ndim if d < 0 else d for d in dims]
+        if sorted(dims) != list(range(self.ndim)):
+            raise ValueError("permute dims {} are not a permutation of {} dimensions".format(dims, self.ndim))
+
+        result_tensor = self.tensor.permute(dims)
+
+        result_data = Tensor()
+        result_data.tensor = result_tensor
+        result_data.shape = [self.shape[d] for d in dims]
+        result_data.ndim = self.ndim
+        result_data.numel = self.numel
+
+        result_data.requires_grad = self.requires_grad
+        if result_data.requires_grad:
+            result_data.grad_fn = PermuteBackward(self, dims)
+
+        return result_data
+
     @property
     def T(self):
-        Tensor._C.transpose_tensor.argtypes = [ctypes.POINTER(CTensor)]
-        Tensor._C.transpose_tensor.restype = ctypes.POINTER(CTensor)
 
-        result_tensor_ptr = Tensor._C.transpose_tensor(self.tensor)
+        result_tensor = self.tensor.T()
 
         result_data = Tensor()
-        result_data.tensor = result_tensor_ptr
+        result_data.tensor = result_tensor
         result_data.shape = self.shape.copy()[::-1]
         result_data.ndim = self.ndim
         result_data.numel = self.numel
@@ -554,4 +739,121 @@ class Tensor:
         self.grad = None
         self.grad_fn = None
 
-        return self    
\ No newline at end of file
+        return self    
+
+    def as_leaf(self):
+        """
+        New graph leaf sharing this tensor's data and requires_grad, without its grad_fn
+        """
+        result_data = Tensor()
+        result_data.tensor = self.tensor
+        result_data.shape = self.shape.copy()
+        result_data.ndim = self.ndim
+        result_data.numel = self.numel
+        result_data.requires_grad = self.requires_grad
+
+        return result_data
+
+    def conv2d(self, weight, bias=None, stride=1, padding=0, dilation=1, groups=1):
+        """
+        2D convolution of an NCHW tensor with an [out_channels, in_channels / groups, kh, kw] weight
+        result = x.conv2d(weight, bias, stride=2, padding=1)
+        """
+        stride, padding, dilation = pair(stride), pair(padding), pair(dilation)
+
+        if self.ndim != 4 or weight.ndim != 4:
+            raise ValueError("conv2d expects a 4D NCHW input and a 4D weight")
+        if self.shape[1] != weight.shape[1] * groups:
+            raise ValueError("conv2d weight expects {} input channels but input has {}".format(
+                weight.shape[1] * groups, self.shape[1]))
+
+        out_h = (self.shape[2] + 2 * padding[0] - dilation[0] * (weight.shape[2] - 1) - 1) // stride[0] + 1
+        out_w = (self.shape[3] + 2 * padding[1] - dilation[1] * (weight.shape[3] - 1) - 1) // stride[1] + 1
+
+        result_tensor = self.tensor.conv2d(weight.tensor, bias.tensor if bias is not None else None,
+                                               *stride, *padding, *dilation, groups)
+
+        result_data = Tensor()
+        result_data.tensor = result_tensor
+        result_data.shape = [self.shape[0], weight.shape[0], out_h, out_w]
+        result_data.ndim = 4
+        result_data.numel = 1
+        for s in result_data.shape:
+            result_data.numel *= s
+
+        result_data.requires_grad = self.requires_grad or weight.requires_grad or \
+            (bias is not None and bias.requires_grad)
+        if result_data.requires_grad:
+            result_data.grad_fn = Conv2dBackward(self, weight, bias, stride, padding, dilation, groups)
+
+        return result_data
+
+    def conv2d_grad(self, input, weight, wrt, stride, padding, dilation, groups):
+        """
+        Gradient of conv2d w.r.t. 'input', 'weight' or 'bias', given self as the output gradient
+        """
+        if wrt == 'bias':
+            result_tensor = self.tensor.conv2d_backward_bias()
+            shape = [self.shape[1]]
+        else:
+            fn = self.tensor.conv2d_backward_input if wrt == 'input' else self.tensor.conv2d_backward_weight
+            result_tensor = fn(input.tensor, weight.tensor, *stride, *padding, *dilation, groups)
+            shape = input.shape if wrt == 'input' else weight.shape
+
+        result_data = Tensor()
+        result_data.tensor = result_tensor
+        result_data.shape = shape.copy()
+        result_data.ndim = len(shape)
+        result_data.numel = 1
+        for s in result_data.shape:
+            result_data.numel *= s
+
+        return result_data
+
+    def _pool2d(self, mode, kernel_size, stride, padding):
+        kernel_size = pair(kernel_size)
+        stride = pair(stride) if stride is not None else kernel_size
+        padding = pair(padding)
+
+        if self.ndim != 4:
+            raise ValueError("{}_pool2d expects a 4D NCHW input".format(mode))
+
+        fn = self.tensor.max_pool2d if mode == 'max' else self.tensor.avg_pool2d
+        result_tensor = fn(*kernel_size, *stride, *padding)
+
+        result_data = Tensor()
+        result_data.tensor = result_tensor
+        result_data.shape = [self.shape[0], self.shape[1],
+                             (self.shape[2] + 2 * padding[0] - kernel_size[0]) // stride[0] + 1,
+                             (self.shape[3] + 2 * padding[1] - kernel_size[1]) // stride[1] + 1]
+        result_data.ndim = 4
+        result_data.numel = 1
+        for s in result_data.shape:
+            result_data.numel *= s
+
+        result_data.requires_grad = self.requires_grad
+        if result_data.requires_grad:
+            result_data.grad_fn = Pool2dBackward(self, mode, kernel_size, stride, padding)
+
+        return result_data
+
+    def max_pool2d(self, kernel_size, stride=None, padding=0):
+        return self._pool2d('max', kernel_size, stride, padding)
+
+    def avg_pool2d(self, kernel_size, stride=None, padding=0):
+        return self._pool2d('avg', kernel_size, stride, padding)
+
+    def pool2d_grad(self, input, mode, kernel_size, stride, padding):
+        """
+        Gradient of max_pool2d/avg_pool2d w.r.t. input, given self as the output gradient
+        """
+        fn = self.tensor.max_pool2d_backward if mode == 'max' else self.tensor.avg_pool2d_backward
+        result_tensor = fn(input.tensor, *kernel_size, *stride, *padding)
+
+        result_data = Tensor()
+        result_data.tensor = result_tensor
+        result_data.shape = input.shape.copy()
+        result_data.ndim = input.ndim
+        result_data.numel = input.numel
+
+        return result_data
@@ -12,4 +12,13 @@ def generate_random_list(shape):
         if len(inner_shape) == 0:
             return [random.uniform(-1, 1) for _ in range(shape[0])]
         else:
-            return [generate_random_list(inner_shape) for _ in range(shape[0])]
\ No newline at end of file
+            return [generate_random_list(inner_shape) for _ in range(shape[0])]
+
+def pair(value):
+    """
+    Expand an int argument to an (h, w) pair, e.g. for kernel sizes and strides
+    3 --> (3, 3), (3, 1) --> (3, 1)
+    """
+    if isinstance(value, int):
+        return (value, value)
+    return tuple(value)
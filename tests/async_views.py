@@ -0,0 +1,51 @@
+"""
+Views returned by queued ops keep the right handle alive: a view of a copied
+slice must pin the copy, not the tensor it was sliced from, in both modes.
+
+Run from the repository root: python3 tests/async_views.py
+"""
+import gc
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+import src
+from src.tensor import Tensor
+
+
+def check(asynchronous):
+    src.set_async(asynchronous)
+    a = Tensor.empty([6, 4]).uniform_()
+    data = a.tensor.tolist()
+
+    # A strided slice is a copy, and a row of it a view of that copy
+    y = a[::2]
+    w = y[1]
+    assert y.tensor.base is None
+    assert w.tensor.base is y.tensor
+    del y
+    gc.collect()
+    src.synchronize()
+    assert w.tensor.tolist() == data[8:12]
+
+    # A view of a view points at the handle owning the data
+    v = a[1:5]
+    u = v[1]
+    assert v.tensor.base is a.tensor
+    assert u.tensor.base is a.tensor
+    del a, v
+    gc.collect()
+    src.synchronize()
+    assert u.tensor.tolist() == data[8:12]
+
+
+def main():
+    for asynchronous in (False, True):
+        check(asynchronous)
+        print("{}: ok".format("async" if asynchronous else "sync"))
+    src.set_async(False)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,83 @@
+"""
+Gradients averaged by DistributedDataParallel over several buckets match the
+single-process average, even when a bucket is reduced while backward is still
+using its gradient: Linear's bias shares its gradient with the weight's
+MatmulBackward, which is slowed down here so the bias bucket goes first.
+
+Run from the repository root: python3 tests/ddp_buckets.py
+"""
+import multiprocessing
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+import src
+from src import nn
+from src.autograd import functions
+from src.tensor import Tensor
+
+WORLD_SIZE = 2
+INPUTS = [[[0.5], [-1.0], [2.0]], [[1.5], [0.25], [-0.75]]]
+OUTPUT_GRADS = [[[1.0], [2.0]], [[-3.0], [0.5]]]
+
+
+def make_model():
+    src.manual_seed(0)
+    return nn.Linear(3, 2)
+
+
+def gradients(model):
+    return {name: parameter.grad.tensor.tolist() for _, name, parameter in model.parameters()}
+
+
+def reference():
+    grads = []
+    for x, output_grad in zip(INPUTS, OUTPUT_GRADS):
+        model = make_model()
+        model(Tensor(x)).backward(Tensor(output_grad))
+        grads.append(gradients(model))
+    return {name: [sum(g[name][i] for g in grads) / len(grads) for i in range(len(grads[0][name]))]
+            for name in grads[0]}
+
+
+def run(rank, results):
+    backward = functions.MatmulBackward.backward
+
+    def slow_backward(self, gradient):
+        time.sleep(0.05)
+        return backward(self, gradient)
+
+    functions.MatmulBackward.backward = slow_backward
+
+    group = src.ProcessGroup('/ddp_buckets_test', rank, WORLD_SIZE, capacity=4)
+    model = nn.DistributedDataParallel(make_model(), group, bucket_cap=1)
+    for _ in range(2):
+        model(Tensor(INPUTS[rank])).backward(Tensor(OUTPUT_GRADS[rank]))
+        grads = gradients(model.module)
+        model.module.zero_grad()
+    results.put((rank, len(model._buckets), grads))
+    group.destroy()
+
+
+def main():
+    results = multiprocessing.Queue()
+    processes = [multiprocessing.Process(target=run, args=(rank, results)) for rank in range(WORLD_SIZE)]
+    for process in processes:
+        process.start()
+    outputs = [results.get(timeout=60) for _ in processes]
+    for process in processes:
+        process.join()
+
+    expected = reference()
+    for rank, buckets, grads in outputs:
+        assert buckets == 2
+        for name, values in expected.items():
+            error = max(abs(a - b) for a, b in zip(grads[name], values))
+            assert error < 1e-6, (rank, name, error)
+    print("ok")
+
+
+if __name__ == "__main__":
+    main()